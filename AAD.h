@@ -6,10 +6,12 @@ using namespace std;
 
 #include "gaussians.h"
 #include "BlackScholes.h"
+#include "matrix.h"
+#include "interp.h"
 
 struct Node
 {
-    int     numArg;       //  number of arguments: 0, 1 or 2
+    int     numArg;       //  number of arguments: 0, 1, 2 or more, see recordNode
     int     idx1;         //  index of first argument on tape
     int     idx2;         //  index of second argument on tape
     double  der1;         //  partial derivative to first argument
@@ -272,6 +274,151 @@ struct Number
     friend bool operator<=(const Number& lhs, const Number& rhs){ return lhs.value <= rhs.value; }
 };
 
+//  Records a node with any number of arguments, given their indices on tape and partial derivatives,
+//      so a complex function of many arguments lands on tape as a single node
+//  Argument k is stored in record k / 2 from the node, in the first or second slot,
+//      so arguments beyond the second one are stored two by two in the following records,
+//      which have no arguments of their own, so the backward sweep ignores them
+inline Number recordNode(const double value, const int numArg, const int* idx, const double* der)
+{
+    //  create the record and the extra records for arguments beyond the second one
+    const size_t first = tape.size();
+    tape.resize(first + 1 + max(numArg - 1, 0) / 2);
+
+    //  compute result
+    Number result;
+    result.value = value;
+
+    //  reference record on tape
+    result.idx = int(first);
+
+    //  populate records on tape
+    tape[first].numArg = numArg;
+    for (int k = 0; k < numArg; ++k)
+    {
+        Node& node = tape[first + k / 2];
+        if (k % 2 == 0)
+        {
+            node.idx1 = idx[k];
+            node.der1 = der[k];
+        }
+        else
+        {
+            node.idx2 = idx[k];
+            node.der2 = der[k];
+        }
+    }
+    for (size_t j = first + 1; j < tape.size(); ++j) tape[j].numArg = 0;
+
+    return result;
+}
+
+//  Dedicated node for piecewise polynomials, see polyEval in interp.h:
+//      c[0] + c[1] u + ... + c[N-1] u^(N-1) with u = x - origin,
+//      records the partials to the N coefficients and x in one node
+template <size_t N>
+inline Number polyEval(const Number* c, const double origin, const Number& x)
+{
+    const double u = x.value - origin;
+
+    //  Horner's scheme for the value and its derivative to x
+    double value = 0.0, slope = 0.0;
+    for (size_t k = N; k-- > 0;)
+    {
+        slope = slope * u + value;
+        value = value * u + c[k].value;
+    }
+
+    //  Partials
+    int idx[N + 1];
+    double der[N + 1];
+    double uk = 1.0;
+    for (size_t k = 0; k < N; ++k)
+    {
+        idx[k] = c[k].idx;
+        der[k] = uk;
+        uk *= u;
+    }
+    idx[N] = x.idx;
+    der[N] = slope;
+
+    return recordNode(value, int(N + 1), idx, der);
+}
+
+//  Dedicated node for 2D interpolation, overloads interp2D in interp.h
+//  The value is computed with doubles, and one node is recorded 
+//      with the (up to four) bracketing zs, x0 and y0 as arguments
+//      and their weights and sensitivities as partials, skipping zeros (for instance, in extrapolation)
+//  The knots are constants, sensitivities to their positions are not computed
+template <bool smoothStep=false>
+inline Number interp2D(
+    //	sorted on xs 
+    const vector<Number>&       x,
+    //	sorted on ys
+    const vector<Number>&       y,
+    //  zs in a matrix
+    const matrix<Number>&       z,
+    //	interpolate for point (x0,y0)
+    const Number&				x0,
+    const Number&				y0)
+{
+    //  Bracket, weight and derivative of the weight for a point in knots,
+    //      flat extrapolation with both brackets on the edge knot and zero weight
+    auto bracket = [](const vector<Number>& knots, const double p, size_t& i1, size_t& i2, double& w, double& dw)
+    {
+        const size_t n = knots.size();
+        i2 = distance(knots.begin(), upper_bound(knots.begin(), knots.end(), p,
+            [](const double a, const Number& b) { return a < b.value; }));
+        if (i2 == 0 || i2 == n)
+        {
+            i1 = i2 = i2 ? n - 1 : 0;
+            w = dw = 0.0;
+            return;
+        }
+        i1 = i2 - 1;
+        const double h = knots[i2].value - knots[i1].value, t = (p - knots[i1].value) / h;
+        if constexpr (smoothStep)
+        {
+            w = t * t * (3.0 - 2 * t);
+            dw = 6.0 * t * (1.0 - t) / h;
+        }
+        else
+        {
+            w = t;
+            dw = 1.0 / h;
+        }
+    };
+
+    size_t r1, r2, c1, c2;
+    double wx, dwx, wy, dwy;
+    bracket(x, x0.value, r1, r2, wx, dwx);
+    bracket(y, y0.value, c1, c2, wy, dwy);
+
+    //  Value, like interp2D
+    const double z11 = z[r1][c1].value, z12 = z[r1][c2].value, z21 = z[r2][c1].value, z22 = z[r2][c2].value;
+    const double z1 = z11 + (z12 - z11) * wy, z2 = z21 + (z22 - z21) * wy;
+    const double value = z1 + (z2 - z1) * wx;
+
+    //  Arguments and partials
+    const int idx[6] = { z[r1][c1].idx, z[r1][c2].idx, z[r2][c1].idx, z[r2][c2].idx, x0.idx, y0.idx };
+    const double der[6] = {
+        (1.0 - wx) * (1.0 - wy), (1.0 - wx) * wy, wx * (1.0 - wy), wx * wy,
+        (z2 - z1) * dwx,
+        ((1.0 - wx) * (z12 - z11) + wx * (z22 - z21)) * dwy };
+
+    int nzIdx[6];
+    double nzDer[6];
+    int numArg = 0;
+    for (int k = 0; k < 6; ++k) if (der[k] != 0.0)
+    {
+        nzIdx[numArg] = idx[k];
+        nzDer[numArg] = der[k];
+        ++numArg;
+    }
+
+    return recordNode(value, numArg, nzIdx, nzDer);
+}
+
 inline vector<double> calculateAdjoints(Number& result)
 {
     //  initialization
@@ -291,6 +438,65 @@ inline vector<double> calculateAdjoints(Number& result)
                 //  propagate second argument
                 adjoints[tape[j].idx2] += adjoints[j] * tape[j].der2;   
             }
+            //  propagate further arguments, from the following records, see recordNode
+            for (int k = 2; k < tape[j].numArg; ++k)
+            {
+                const Node& node = tape[j + k / 2];
+                if (k % 2 == 0) adjoints[node.idx1] += adjoints[j] * node.der1;
+                else adjoints[node.idx2] += adjoints[j] * node.der2;
+            }
+        }
+    }
+
+    return adjoints;
+}
+
+//  Multi-adjoint sweep: the adjoints of several results in one backward pass over the tape
+//  Every record carries a vector of adjoints, one per result, propagated together,
+//      so the cost is one sweep over the tape, with short vectorized loops, rather than one sweep per result
+//  Returns a matrix of tape size x number of results: adjoints[i][k] is the derivative of results[k] to record i
+inline matrix<double> calculateAdjoints(const vector<Number>& results)
+{
+    const size_t K = results.size();
+
+    //  initialization
+    matrix<double> adjoints(tape.size(), K);    //  initialize all to 0
+    int N = 0;
+    for (size_t k = 0; k < K; ++k)
+    {
+        adjoints[results[k].idx][k] += 1.0;     //  seed the adjoint of every result
+        N = max(N, results[k].idx);             //  start from the last one
+    }
+
+    //  propagate the adjoints of j to argument idx with partial der
+    auto propagate = [&](const double* aj, const int idx, const double der)
+    {
+        double* ai = adjoints[idx];
+        for (size_t k = 0; k < K; ++k) ai[k] += aj[k] * der;
+    };
+
+    //  backward propagation
+    for (int j = N; j > 0; --j)
+    {
+        const Node& node = tape[j];
+        if (node.numArg > 0)
+        {
+            const double* aj = adjoints[j];
+
+            //  skip records that don't contribute to any result
+            bool zero = true;
+            for (size_t k = 0; k < K; ++k) zero = zero && aj[k] == 0.0;
+            if (zero) continue;
+
+            propagate(aj, node.idx1, node.der1);
+            if (node.numArg > 1) propagate(aj, node.idx2, node.der2);
+            //  further arguments, see recordNode
+            for (int k = 2; k < node.numArg; ++k)
+            {
+                const Node& extra = tape[j + k / 2];
+                if (k % 2 == 0) propagate(aj, extra.idx1, extra.der1);
+                else propagate(aj, extra.idx2, extra.der2);
+            }
         }
     }
 
@@ -37,4 +37,140 @@ const T mat)
     auto d1 = d + 0.5 * std, d2 = d - 0.5 * std;
     auto p1 = normalCdf(d1), p2 = normalCdf(d2);
     return df * (fwd * p1 - strike * p2);
-}
\ No newline at end of file
+}
+
+//  Up-and-out call with continuous monitoring, zero rates and dividends
+//  The call paid on the paths finishing between the strike and the barrier,
+//      minus, by the reflection principle, the same on the paths that hit the barrier before
+//  Zero when the spot or the strike is at or above the barrier
+template <class T>
+inline T blackScholesUpOut(
+const T spot, 
+const T vol, 
+const T strike, 
+const T barrier, 
+const T mat)
+{
+    if (spot >= barrier || strike >= barrier) return T(0.0);
+
+    auto std = vol * sqrt(mat);
+    auto x1 = log(spot / strike) / std + 0.5 * std,
+        x2 = log(spot / barrier) / std + 0.5 * std,
+        y1 = log(barrier * barrier / (spot * strike)) / std + 0.5 * std,
+        y2 = log(barrier / spot) / std + 0.5 * std;
+    auto ratio = spot / barrier;
+
+    return spot * normalCdf(x1) - strike * normalCdf(x1 - std)
+        - spot * normalCdf(x2) + strike * normalCdf(x2 - std)
+        + barrier * normalCdf(-y1) - strike * ratio * normalCdf(std - y1)
+        - barrier * normalCdf(-y2) + strike * ratio * normalCdf(std - y2);
+}
+
+//  Batch of options
+//  ================
+
+//  Prices n options given in structure of arrays, 
+//      in parallel over chunks of options, 
+//      with the math (exp, log, sqrt, normalCdf) in separate vectorizable loops over the chunk
+//  Optionally, computes analytic greeks in the same pass
+
+//  Optional outputs, nullptr to skip
+struct BlackScholesGreeks
+{
+    double* delta = nullptr;    //  to spot
+    double* gamma = nullptr;    //  second order to spot
+    double* vega = nullptr;     //  to volatility
+    double* rho = nullptr;      //  to rate
+    double* theta = nullptr;    //  to maturity
+};
+
+template <bool accurate = false>
+inline void blackScholesBatch(
+    //  Number of options
+    const size_t        n,
+    //  Inputs, arrays of n
+    const double*       spot,
+    const double*       rate,
+    const double*       yield,
+    const double*       vol,
+    const double*       strike,
+    const double*       mat,
+    //  Results, array of n
+    double*             price,
+    //  Optional greeks
+    const BlackScholesGreeks&   greeks = BlackScholesGreeks())
+{
+    //  Options in a chunk fit in the L1 cache
+    constexpr size_t chunk = 256;
+    const long long numChunks = n ? (long long)((n - 1) / chunk) + 1 : 0;
+
+    const bool needDens = greeks.gamma || greeks.vega || greeks.theta;
+
+    #pragma omp parallel for
+    for (long long c = 0; c < numChunks; ++c)
+    {
+        const size_t first = size_t(c) * chunk;
+        const size_t m = min(chunk, n - first);
+
+        //  Working memory, on the stack
+        double df[chunk], fwd[chunk], std[chunk], d1[chunk], d2[chunk], p1[chunk], p2[chunk], n1[chunk];
+
+        //  Discount, forward, standard deviation
+        for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            df[i] = exp(-rate[k] * mat[k]);
+            fwd[i] = spot[k] * exp((rate[k] - yield[k]) * mat[k]);
+            std[i] = vol[k] * sqrt(mat[k]);
+        }
+
+        //  d1, d2
+        for (size_t i = 0; i < m; ++i)
+        {
+            const double d = log(fwd[i] / strike[first + i]) / std[i];
+            d1[i] = d + 0.5 * std[i];
+            d2[i] = d - 0.5 * std[i];
+        }
+
+        //  Normal distributions
+        normalCdf<accurate>(d1, p1, m);
+        normalCdf<accurate>(d2, p2, m);
+        if (needDens) normalDens(d1, n1, m);
+
+        //  Price
+        for (size_t i = 0; i < m; ++i)
+        {
+            price[first + i] = df[i] * (fwd[i] * p1[i] - strike[first + i] * p2[i]);
+        }
+
+        //  Greeks
+        //  df * fwd / spot = exp(-yield * mat)
+        if (greeks.delta) for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            greeks.delta[k] = df[i] * fwd[i] / spot[k] * p1[i];
+        }
+        if (greeks.gamma) for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            greeks.gamma[k] = df[i] * fwd[i] / spot[k] * n1[i] / (spot[k] * std[i]);
+        }
+        if (greeks.vega) for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            greeks.vega[k] = df[i] * fwd[i] * n1[i] * sqrt(mat[k]);
+        }
+        if (greeks.rho) for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            greeks.rho[k] = strike[k] * mat[k] * df[i] * p2[i];
+        }
+        if (greeks.theta) for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            greeks.theta[k] = df[i] * fwd[i] * n1[i] * vol[k] / (2.0 * sqrt(mat[k]))
+                - yield[k] * df[i] * fwd[i] * p1[i]
+                + rate[k] * strike[k] * df[i] * p2[i];
+        }
+    }
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+//  Black-Scholes model and European calls, for the generic Monte-Carlo engine of mcEngine.h
+//  ========================================================================================
+
+//  The spot follows dS/S = vol dW with a flat vol, zero rates and dividends
+//  Log steps are exact, so the Monte-Carlo prices of European options converge to the closed form of BlackScholes.h
+//      without discretization bias, which makes them control variates with known means, see mcSimulCV
+//  So do the prices of up-and-out calls monitored continuously with the Brownian bridge, which is exact with a flat vol
+
+//  The paths are computed in doubles, as Brownian motions, then scaled into spots,
+//      so with AAD they only cost a few nodes per date and path
+
+#include "matrix.h"
+#include "BlackScholes.h"
+
+#include <type_traits>
+#include <stdexcept>
+
+//  Continuous monitoring of an up barrier with the Brownian bridge, on the paths of a product, the first date today:
+//      the surviving notional is multiplied by the probability that the spot did not cross the barrier between the dates,
+//      given its values on the dates and the variance integrated in between, see BarrierOption,
+//      1 - exp(-2 log(barrier / S(t_j-1)) log(barrier / S(t_j)) / variance), and 0 above the barrier
+template <class T>
+inline void bridgeSurvival(
+    const T&            barrier,
+    const T* const*     paths,
+    const T* const*     variances,
+    const size_t        numDates,
+    const size_t        n,
+    T*                  notionalAlive)
+{
+    //  Log-distance to the barrier at the start of the step, 0 above
+    static thread_local vector<T> distance;
+    distance.resize(n);
+
+    for (size_t j = 0; j < numDates; ++j)
+    {
+        const T* spot = paths[j];
+
+        if constexpr (is_same<T, double>::value)
+        {
+            //  Without branches, so the loops vectorize
+            for (size_t p = 0; p < n; ++p)
+            {
+                const double end = max(log(barrier / spot[p]), 0.0);
+                if (j)
+                {
+                    const double var = max(variances[j][p] - variances[j - 1][p], 1.0e-300);
+                    notionalAlive[p] *= 1.0 - exp(-2.0 * distance[p] * end / var);
+                }
+                distance[p] = end;
+            }
+        }
+        else
+        {
+            //  With AAD, the paths above the barrier die without recording
+            for (size_t p = 0; p < n; ++p)
+            {
+                if (spot[p] >= barrier)
+                {
+                    notionalAlive[p] = 0.0;
+                    distance[p] = 0.0;
+                    continue;
+                }
+                const T end = log(barrier / spot[p]);
+                if (j && notionalAlive[p].value != 0.0)
+                {
+                    notionalAlive[p] *= 1.0 - exp(-2.0 * distance[p] * end / (variances[j][p] - variances[j - 1][p]));
+                }
+                distance[p] = end;
+            }
+        }
+    }
+}
+
+template <class T>
+class BlackScholesModel
+{
+    //  Parameters
+    T                   myS0;
+    T                   myVol;
+
+    //  Simulation, set by init
+    vector<double>      myTimes;
+    vector<double>      mySqrtDts;
+    size_t              myNumSteps = 0;
+
+    template <class U> friend class BlackScholesModel;
+
+public:
+
+    BlackScholesModel(const T& S0, const T& vol) : myS0(S0), myVol(vol)
+    {
+        if (vol < 0.0) throw runtime_error("BlackScholesModel: negative vol");
+    }
+
+    //  Conversion, puts the parameters on tape with T = Number, the simulation must be initialized again
+    template <class U>
+    BlackScholesModel(const BlackScholesModel<U>& rhs) : myS0(rhs.myS0), myVol(rhs.myVol) {}
+
+    const T& S0() const { return myS0; }
+    const T& vol() const { return myVol; }
+
+    //  Steps between the event dates, starting today
+    //  Today as an event date is not a step: its spot is S0 and it consumes no Gaussian
+    void init(const vector<double>& timeline)
+    {
+        const size_t n = timeline.size();
+        myTimes = timeline;
+        mySqrtDts.resize(n);
+        myNumSteps = 0;
+
+        double t = 0.0;
+        for (size_t j = 0; j < n; ++j)
+        {
+            mySqrtDts[j] = sqrt(timeline[j] - t);
+            if (timeline[j] > t) ++myNumSteps;
+            t = timeline[j];
+        }
+    }
+
+    //  One Gaussian per step of positive length
+    size_t simDim() const { return myNumSteps; }
+
+    //  Step by step, all paths in the block
+    void generatePaths(const matrix<double>& gaussians, matrix<T>& paths, matrix<T>* variances, const size_t n) const
+    {
+        //  Brownian motion
+        static thread_local vector<double> brownian;
+        brownian.assign(n, 0.0);
+
+        size_t g = 0;
+        for (size_t j = 0; j < myTimes.size(); ++j)
+        {
+            const double sdt = mySqrtDts[j];
+            if (sdt > 0.0)
+            {
+                const double* z = gaussians[g++];
+                for (size_t p = 0; p < n; ++p) brownian[p] += sdt * z[p];
+            }
+
+            //  Exact log step: S = S0 exp(-vol^2 t / 2 + vol W)
+            const T drift = -0.5 * myVol * myVol * myTimes[j];
+            T* spot = paths[j];
+            for (size_t p = 0; p < n; ++p) spot[p] = myS0 * exp(drift + myVol * brownian[p]);
+
+            //  Integrated variance, the same on all paths
+            if (variances)
+            {
+                T* var = (*variances)[j];
+                fill(var, var + n, myVol * myVol * myTimes[j]);
+            }
+        }
+    }
+
+    vector<T*> parameters()
+    {
+        return { &myS0, &myVol };
+    }
+
+    //  Closed form price of a European call
+    T call(const double maturity, const T& strike) const
+    {
+        return blackScholes<T>(myS0, T(0.0), T(0.0), myVol, strike, T(maturity));
+    }
+
+    //  Closed form price of an up-and-out call with continuous monitoring
+    T upOutCall(const double maturity, const T& strike, const T& barrier) const
+    {
+        return blackScholesUpOut<T>(myS0, myVol, strike, barrier, T(maturity));
+    }
+};
+
+//  European call, a product with a closed form in Black-Scholes
+//  Optionally up-and-out, monitored continuously with the Brownian bridge on Nt equally spaced dates after today
+template <class T>
+class EuropeanCall
+{
+    double          myMaturity;
+    T               myStrike;
+    T               myBarrier;
+    bool            myUpOut = false;
+
+    //  The maturity, or today then the monitoring dates of the barrier
+    vector<double>  myTimeline;
+
+    template <class U> friend class EuropeanCall;
+
+public:
+
+    EuropeanCall(const double maturity, const T& strike)
+        : myMaturity(maturity), myStrike(strike), myBarrier(0.0), myTimeline(1, maturity)
+    {
+        if (maturity <= 0.0) throw runtime_error("EuropeanCall: maturity must be positive");
+    }
+
+    EuropeanCall(const double maturity, const T& strike, const T& barrier, const int Nt)
+        : myMaturity(maturity), myStrike(strike), myBarrier(barrier), myUpOut(true), myTimeline(1, 0.0)
+    {
+        if (maturity <= 0.0) throw runtime_error("EuropeanCall: maturity must be positive");
+        if (Nt < 1) throw runtime_error("EuropeanCall: at least one monitoring date is needed");
+        for (int j = 0; j < Nt; ++j) myTimeline.push_back(maturity * (j + 1) / Nt);
+    }
+
+    //  Conversion, puts the parameters on tape with T = Number
+    template <class U>
+    EuropeanCall(const EuropeanCall<U>& rhs)
+        : myMaturity(rhs.myMaturity), myStrike(rhs.myStrike), myBarrier(rhs.myBarrier), myUpOut(rhs.myUpOut),
+        myTimeline(rhs.myTimeline) {}
+
+    double maturity() const { return myMaturity; }
+    const T& strike() const { return myStrike; }
+    const T& barrier() const { return myBarrier; }
+    bool upOut() const { return myUpOut; }
+
+    const vector<double>& timeline() const { return myTimeline; }
+
+    //  The Brownian bridge reads the integrated variances
+    bool needsVariances() const { return myUpOut; }
+
+    void payoffs(const T* const* paths, const T* const* variances, const size_t n, T* payoffs) const
+    {
+        static thread_local vector<T> notionalAlive;
+        notionalAlive.assign(n, T(1.0));
+        if (myUpOut) bridgeSurvival(myBarrier, paths, variances, myTimeline.size(), n, notionalAlive.data());
+
+        const T* spot = paths[myTimeline.size() - 1];
+        for (size_t p = 0; p < n; ++p)
+        {
+            if constexpr (is_same<T, double>::value)
+            {
+                payoffs[p] = notionalAlive[p] * max(spot[p] - myStrike, 0.0);
+            }
+            else
+            {
+                payoffs[p] = spot[p] > myStrike ? notionalAlive[p] * (spot[p] - myStrike) : T(0.0);
+            }
+        }
+    }
+
+    //  Known mean, for control variates
+    T expectation(const BlackScholesModel<T>& model) const
+    {
+        return myUpOut ? model.upOutCall(myMaturity, myStrike, myBarrier) : model.call(myMaturity, myStrike);
+    }
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "random.h"
+#include "matrix.h"
+
+#include <math.h>
+
+//  Brownian bridge construction of Gaussian increments
+//  ===================================================
+
+//  The first Gaussian number builds the terminal point of the Brownian path,
+//      the second one the mid point, then the quarter points, and so on
+//  So the first dimensions of the RNG drive the coarsest features of the path
+//  This is essential with Sobol, where the first dimensions are of much better quality
+//  See Glasserman, Monte Carlo Methods in Financial Engineering, section 3.1
+//      and Jaeckel, Monte Carlo Methods in Finance, section 10.8
+
+//  The results are (standard, independent) Gaussian increments over the timeline,
+//      so the bridge plugs into simulation code without modification
+
+class BrownianBridge
+{
+    //  Number of time steps
+    size_t          myNt;
+
+    //  The plan, precomputed on construction
+    //  Construction step k builds the Brownian path in index myIdx[k]
+    //      out of the path in myLeft[k] and myRight[k], already built,
+    //      and the k-th Gaussian number:
+    //  W[myIdx[k]] = myLw[k] * W[myLeft[k]] + myRw[k] * W[myRight[k]] + myStd[k] * z[k]
+    //  Step 0 builds the terminal point out of z[0] alone
+    //  When the left point is time 0 (W = 0), myLw = 0 and myLeft points to the right point,
+    //      so the construction is branch-free
+    vector<size_t>  myIdx, myLeft, myRight;
+    vector<double>  myLw, myRw, myStd;
+
+    //  1 / sqrt(dt) for the normalization of increments
+    vector<double>  myInvSqrtDt;
+
+public:
+
+    BrownianBridge() : myNt(0) {}
+
+    //  Nt equally spaced time steps
+    explicit BrownianBridge(const size_t Nt)
+    {
+        vector<double> times(Nt);
+        for (size_t i = 0; i < Nt; ++i) times[i] = double(i + 1);
+        build(times);
+    }
+
+    //  Arbitrary timeline t1 < t2 < ... < tN, excluding time 0
+    explicit BrownianBridge(const vector<double>& times)
+    {
+        build(times);
+    }
+
+    size_t steps() const { return myNt; }
+
+    //  Transform independent Gaussians z[Nt] into Gaussian increments dW[Nt]
+    //  z and dW must not overlap
+    void transform(const double* z, double* dW) const
+    {
+        if (!myNt) return;
+
+        //  Build the Brownian path in dW, terminal point first
+        dW[myNt - 1] = myStd[0] * z[0];
+        for (size_t k = 1; k < myNt; ++k)
+        {
+            dW[myIdx[k]] = myLw[k] * dW[myLeft[k]] + myRw[k] * dW[myRight[k]] + myStd[k] * z[k];
+        }
+
+        //  Path to normalized increments, backwards
+        for (size_t i = myNt - 1; i > 0; --i)
+        {
+            dW[i] = (dW[i] - dW[i - 1]) * myInvSqrtDt[i];
+        }
+        dW[0] *= myInvSqrtDt[0];
+    }
+
+    //  Same thing, over a block of paths, in (Nt x paths) matrices:
+    //      z[k][p] is the k-th Gaussian number of path p
+    //  The inner loops are over paths, contiguous in memory, so they vectorize
+    //  z and dW must be distinct and dW must be allocated by the caller
+    void transform(const matrix<double>& z, matrix<double>& dW) const
+    {
+        const size_t Np = z.cols();
+        if (!myNt) return;
+
+        {
+            const double std = myStd[0];
+            const double* z0 = z[0];
+            double* out = dW[myNt - 1];
+            for (size_t p = 0; p < Np; ++p) out[p] = std * z0[p];
+        }
+
+        for (size_t k = 1; k < myNt; ++k)
+        {
+            const double lw = myLw[k], rw = myRw[k], std = myStd[k];
+            const double* left = dW[myLeft[k]];
+            const double* right = dW[myRight[k]];
+            const double* zk = z[k];
+            double* out = dW[myIdx[k]];
+            for (size_t p = 0; p < Np; ++p)
+            {
+                out[p] = lw * left[p] + rw * right[p] + std * zk[p];
+            }
+        }
+
+        for (size_t i = myNt - 1; i > 0; --i)
+        {
+            const double isdt = myInvSqrtDt[i];
+            const double* prev = dW[i - 1];
+            double* cur = dW[i];
+            for (size_t p = 0; p < Np; ++p)
+            {
+                cur[p] = (cur[p] - prev[p]) * isdt;
+            }
+        }
+        {
+            const double isdt = myInvSqrtDt[0];
+            double* cur = dW[0];
+            for (size_t p = 0; p < Np; ++p) cur[p] *= isdt;
+        }
+    }
+
+private:
+
+    //  Build the plan, see Jaeckel, section 10.8.3
+    void build(const vector<double>& t)
+    {
+        myNt = t.size();
+
+        myIdx.resize(myNt);
+        myLeft.resize(myNt);
+        myRight.resize(myNt);
+        myLw.resize(myNt);
+        myRw.resize(myNt);
+        myStd.resize(myNt);
+        myInvSqrtDt.resize(myNt);
+
+        if (!myNt) return;
+
+        //  Normalization
+        myInvSqrtDt[0] = 1.0 / sqrt(t[0]);
+        for (size_t i = 1; i < myNt; ++i) myInvSqrtDt[i] = 1.0 / sqrt(t[i] - t[i - 1]);
+
+        //  built[i] is true when point i is built
+        vector<bool> built(myNt, false);
+
+        //  First, the terminal point
+        myIdx[0] = myLeft[0] = myRight[0] = myNt - 1;   //  unused
+        myLw[0] = myRw[0] = 0.0;
+        myStd[0] = sqrt(t[myNt - 1]);
+        built[myNt - 1] = true;
+
+        //  Then, bisect the gaps left to right, from coarse to fine
+        size_t j = 0;
+        for (size_t k = 1; k < myNt; ++k)
+        {
+            //  Find the next gap [j, r) of points not built
+            while (built[j]) ++j;
+            size_t r = j;
+            while (!built[r]) ++r;
+
+            //  Point in the middle of the gap
+            const size_t l = j + ((r - 1 - j) >> 1);
+
+            //  Left time and point, time 0 if the gap starts at 0
+            const double tl = j ? t[j - 1] : 0.0;
+
+            myIdx[k] = l;
+            myRight[k] = r;
+            myLeft[k] = j ? j - 1 : r;
+            myLw[k] = j ? (t[r] - t[l]) / (t[r] - tl) : 0.0;
+            myRw[k] = (t[l] - tl) / (t[r] - tl);
+            myStd[k] = sqrt((t[l] - tl) * (t[r] - t[l]) / (t[r] - tl));
+            built[l] = true;
+
+            //  Next gap, restart from the left at the end of the timeline
+            j = r + 1;
+            if (j >= myNt) j = 0;
+        }
+    }
+};
+
+//  RNG adapter, applies the Brownian bridge to the Gaussians of another RNG
+//  On equally spaced time steps with init, on the actual steps of the model with initSteps,
+//      which the generic engine calls, see mcInitRNG in mcEngine.h
+//  Uniforms are forwarded untouched
+class BrownianBridgeRNG : public RNG
+{
+    unique_ptr<RNG>     myRng;
+    BrownianBridge      myBridge;
+
+    //  Working memory for the underlying Gaussians
+    vector<double>      myGaussians;
+
+public:
+
+    explicit BrownianBridgeRNG(unique_ptr<RNG> rng) : myRng(move(rng)) {}
+
+    //  Copy: clone the underlying RNG
+    BrownianBridgeRNG(const BrownianBridgeRNG& rhs) :
+        myRng(rhs.myRng->clone()),
+        myBridge(rhs.myBridge),
+        myGaussians(rhs.myGaussians) {}
+
+    //  Virtual copy constructor
+    unique_ptr<RNG> clone() const override
+    {
+        return make_unique<BrownianBridgeRNG>(*this);
+    }
+
+    //  Initializers, build the plan
+    void init(const size_t simDim) override
+    {
+        myRng->init(simDim);
+        myBridge = BrownianBridge(simDim);
+        myGaussians.resize(simDim);
+    }
+
+    void initSteps(const vector<double>& stepTimes) override
+    {
+        myRng->initSteps(stepTimes);
+        myBridge = BrownianBridge(stepTimes);
+        myGaussians.resize(stepTimes.size());
+    }
+
+    void nextU(vector<double>& uVec) override
+    {
+        myRng->nextU(uVec);
+    }
+
+    void nextG(vector<double>& gaussVec) override
+    {
+        myRng->nextG(myGaussians);
+        myBridge.transform(myGaussians.data(), gaussVec.data());
+    }
+
+    //  Skip ahead
+    void skipTo(const unsigned long long b) override
+    {
+        myRng->skipTo(b);
+    }
+};
@@ -2,75 +2,146 @@
 
 #include "matrix.h"
 #include "random.h"
-#include "interp.h"
+#include "localVol.h"
 #include "AAD.h"
-
-#include <numeric>
-
+#include "mcEngine.h"
+#include "dupireModel.h"
+
+#include <type_traits>
+#include <stdexcept>
+
+//  Up-and-out call, for the generic Monte-Carlo engine of mcEngine.h
+//  The barrier is monitored on Nt equally spaced dates and smoothed over [barrier - epsilon, barrier + epsilon]:
+//      on every date, the surviving notional is multiplied by
+//      0 above barrier + epsilon, 1 below barrier - epsilon, and interpolated in between
+//  Or, with continuous monitoring, the Nt dates are the time steps of a Brownian bridge correction:
+//      the surviving notional is multiplied by the probability that the spot did not cross the barrier between the dates,
+//      given its values on the dates and the variance integrated in between, with the local vol of the step,
+//      1 - exp(-2 log(barrier / S(t_j-1)) log(barrier / S(t_j)) / variance), and 0 above the barrier
+//  The probability is continuous in the spots, vanishing on the barrier, so smoothing is not needed and epsilon is ignored
+//  The discrete monitoring bias, in the square root of the step, is removed,
+//      so the price converges to continuous monitoring with much fewer steps
 template <class T>
-inline T dupireBarrierMCBatch(
-    //  Spot
-    const T            S0,
-    //  Local volatility
-    const vector<T>&   spots,
-    const vector<T>&   times,
-    const matrix<T>&   vols,
-    //  Product parameters
-    const T            maturity,
-    const T            strike,
-    const T            barrier,
-    //  First and last path
-    const int          firstPath,
-	const int		   lastPath,
-	//	Time steps
-    const int          Nt,
-    //  Smoothing
-    const T            epsilon,
-    //  Random number generator
-    RNG&               random)
+class BarrierOption
 {
-    //  Initialize
-    T result = 0;
-    vector<double> gaussianIncrements(Nt); 
-	//	double because the RNG is not templated
-	//  	(and correctly so, see chapter 12)
-	
-	//	Set RNG state to the first path in the batch
-	random.skipTo(firstPath);
-
-    //  Loop over paths
-    const T dt = maturity / Nt, sdt = sqrt(dt);
-    for (int i = firstPath; i < lastPath; ++i)
+    //  Parameters
+    double          myMaturity;
+    T               myStrike;
+    T               myBarrier;
+    T               myEpsilon;
+    bool            myContinuous;
+
+    //  Monitoring dates, with today first under continuous monitoring, not a simulation step, see DupireModel::init
+    vector<double>  myTimeline;
+
+    template <class U> friend class BarrierOption;
+
+public:
+
+    BarrierOption(
+        const double    maturity,
+        const T&        strike,
+        const T&        barrier,
+        //  Smoothing
+        const T&        epsilon,
+        //  Number of monitoring dates, also the time steps of the simulation
+        const int       Nt,
+        //  Continuous monitoring, with the Brownian bridge correction between the dates
+        const bool      continuous = false)
+        : myMaturity(maturity), myStrike(strike), myBarrier(barrier), myEpsilon(epsilon), myContinuous(continuous)
+    {
+        if (Nt < 1) throw runtime_error("BarrierOption: at least one monitoring date is needed");
+        if (continuous) myTimeline.push_back(0.0);
+        for (int j = 0; j < Nt; ++j) myTimeline.push_back(maturity * (j + 1) / Nt);
+    }
+
+    //  Conversion, puts the parameters on tape with T = Number
+    template <class U>
+    BarrierOption(const BarrierOption<U>& rhs)
+        : myMaturity(rhs.myMaturity), myStrike(rhs.myStrike), myBarrier(rhs.myBarrier), myEpsilon(rhs.myEpsilon),
+        myContinuous(rhs.myContinuous), myTimeline(rhs.myTimeline) {}
+
+    double maturity() const { return myMaturity; }
+    const T& strike() const { return myStrike; }
+    const T& barrier() const { return myBarrier; }
+    const T& epsilon() const { return myEpsilon; }
+    bool continuous() const { return myContinuous; }
+
+    const vector<double>& timeline() const { return myTimeline; }
+
+    //  The Brownian bridge correction reads the integrated variances
+    bool needsVariances() const { return myContinuous; }
+
+    void payoffs(const T* const* paths, const T* const* variances, const size_t n, T* payoffs) const
     {
-        //  Generate Nt Gaussian Numbers
-        random.nextG(gaussianIncrements);
-
-		//	Inntialize path
-        T spot = S0, time = 0;
-        T notionalAlive = 1.0; 
-        
-		//  Step by step
-		for (int j = 0; j < Nt; ++j)
+        static thread_local vector<T> notionalAlive;
+        notionalAlive.assign(n, T(1.0));
+
+        //  Continuous monitoring with the Brownian bridge, see blackScholesModel.h, the first date is today
+        if (myContinuous) bridgeSurvival(myBarrier, paths, variances, myTimeline.size(), n, notionalAlive.data());
+        else discreteSurvival(paths, n, notionalAlive.data());
+
+        //  Pay on surviving notional
+        const T* spot = paths[myTimeline.size() - 1];
+        for (size_t p = 0; p < n; ++p)
         {
-            //  Interpolate volatility
-            const T vol = interp2D(spots, times, vols, spot, time);
-            //  Simulate return
-            spot *= exp(-0.5 * vol * vol * dt + vol * sdt * gaussianIncrements[j]);
-			//	Increase time
-			time += dt;
-
-            //  Monitor barrier
-            if (spot > barrier + epsilon) { notionalAlive = 0.0; break; }       //   definitely dead
-            else if (spot < barrier - epsilon) { /* do nothing */ }     //   definitely alive
-            else /* in between, interpolate */ notionalAlive *= 1.0 - (spot - barrier + epsilon) / (2 * epsilon);
+            if constexpr (is_same<T, double>::value)
+            {
+                payoffs[p] = notionalAlive[p] * max(spot[p] - myStrike, 0.0);
+            }
+            else
+            {
+                payoffs[p] = spot[p] > myStrike ? notionalAlive[p] * (spot[p] - myStrike) : T(0.0);
+            }
         }
+    }
 
-        //  Payoff
-        if (spot > strike) result += notionalAlive * (spot - strike); // pay on surviving notional
-    }   
+private:
 
-    return result / (lastPath - firstPath);
-}
+    //  Smoothed discrete monitoring
+    void discreteSurvival(const T* const* paths, const size_t n, T* notionalAlive) const
+    {
+        const T lo = myBarrier - myEpsilon, hi = myBarrier + myEpsilon, twoEps = 2 * myEpsilon;
+
+        //  Monitor barrier
+        for (size_t j = 0; j < myTimeline.size(); ++j)
+        {
+            const T* spot = paths[j];
+
+            if constexpr (is_same<T, double>::value)
+            {
+                //  Without branches, so the loops vectorize
+                if (myEpsilon > 0.0)
+                {
+                    for (size_t p = 0; p < n; ++p)
+                    {
+                        const double survival = 1.0 - (spot[p] - lo) / twoEps;
+                        notionalAlive[p] *= min(max(survival, 0.0), 1.0);
+                    }
+                }
+                else
+                {
+                    for (size_t p = 0; p < n; ++p)
+                    {
+                        notionalAlive[p] = spot[p] > myBarrier ? 0.0 : notionalAlive[p];
+                    }
+                }
+            }
+            else
+            {
+                //  With AAD, only record the smoothing in between
+                for (size_t p = 0; p < n; ++p)
+                {
+                    if (spot[p] > hi) notionalAlive[p] = 0.0;                           //  definitely dead
+                    else if (spot[p] < lo) { /* do nothing */ }                         //  definitely alive
+                    else notionalAlive[p] *= 1.0 - (spot[p] - lo) / twoEps;             //  in between, interpolate
+                }
+            }
+        }
+    }
+};
+
+//  The drivers of the barrier option in Dupire's model, see mcEngine.h
 
 inline double dupireBarrierPricer(
     //  Spot
@@ -84,7 +155,7 @@ inline double dupireBarrierPricer(
     const double            strike,
     const double            barrier,
     //  Number of paths
-    const int				Np,
+    const long long			Np,
 	//	Number of simulations in every batch
 	const int				Nb,
 	//	Time steps
@@ -92,34 +163,29 @@ inline double dupireBarrierPricer(
     //  Smoothing
     const double            epsilon,
     //  Random number generator
-    RNG&					random)
+    RNG&					random,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
 {	
-	random.init(Nt);
-	double result = 0.0;
-	int firstPath = 0;
-
-	while (firstPath < Np)
-	{
-		int lastPath = firstPath + Nb;
-		lastPath = min(lastPath, Np);
-		double batchPrice = dupireBarrierMCBatch(
-			S0, 
-			spots, 
-			times, 
-			vols, 
-			maturity, 
-			strike, 
-			barrier, 
-			firstPath, 
-			lastPath, 
-			Nt, 
-			epsilon, 
-			random);
-		result += batchPrice * (lastPath-firstPath) / Np;
-		firstPath = lastPath;
-	}
-
-	return result;
+    return mcSimul(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        Np,
+        Nb,
+        random);
+}
+
+//  Delta and vegas out of the risks against the parameters of DupireModel
+inline void dupireRisks(
+    const double*           risks,
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    double&                 delta,
+    matrix<double>&         vegas)
+{
+    delta = risks[0];
+    vegas.resize(spots.size(), times.size());
+    copy(risks + 1, risks + 1 + spots.size() * times.size(), vegas.begin());
 }
 
 inline void dupireBarrierRisks(
@@ -134,7 +200,7 @@ inline void dupireBarrierRisks(
     const double            strike,
     const double            barrier,
     //  Number of paths
-    const int				Np,
+    const long long			Np,
 	//	Number of simulations in every batch
 	const int				Nb,
 	//	Time steps
@@ -146,83 +212,20 @@ inline void dupireBarrierRisks(
 	//	Results
 	double&					price,
 	double&					delta,
-	matrix<double>&			vegas)
+	matrix<double>&			vegas,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
 {	
-	//	Allocate and initialize results
-	price = 0.0;
-	delta = 0.0;
-	vegas.resize(spots.size(), times.size());
-	for (auto& vega : vegas) vega = 0.0;
-
-	//	Temporary storage for batch risks
-	double batchPrice, batchDelta;
-	matrix<double> batchVegas(vegas.rows(), vegas.cols());
-
-	//	Temporary storage for parameters as Number types
-	Number nS0, nMaturity, nStrike, nBarrier, nEpsilon;
-	vector<Number> nSpots(spots.size()), nTimes(times.size());
-	matrix<Number> nVols(vols.rows(), vols.cols());
-
-	//	Initialize the RNG
-	random.init(Nt);
-
-	//	Loop over batches
-	int firstPath = 0;
-	while (firstPath < Np)
-	{
-		int lastPath = firstPath + Nb;
-		lastPath = min(lastPath, Np);
-
-		//	Wipe the tape
-		tape.clear();
-		
-		//	Put parameters on tape by initialization of Number types
-		//	Note this is inefficient in many ways but it keeps things simple 
-		//	and doesn't matter too much as long as the number of batches remains low
-		nS0 = S0; 
-		nMaturity = maturity;
-		nStrike = strike; 
-		nBarrier = barrier;
-		nEpsilon = epsilon;
-		copy(spots.begin(), spots.end(), nSpots.begin());
-		copy(times.begin(), times.end(), nTimes.begin());
-		copy(vols.begin(), vols.end(), nVols.begin());
-	
-		//	Compute the batch
-		Number nBatchPrice = dupireBarrierMCBatch(
-			nS0, 
-			nSpots, 
-			nTimes, 
-			nVols, 
-			nMaturity, 
-			nStrike, 
-			nBarrier, 
-			firstPath, 
-			lastPath, 
-			Nt, 
-			nEpsilon, 
-			random);
-
-		//	Back-propagate derivatives
-		vector<double> adjoints = calculateAdjoints(nBatchPrice);
-
-		//	Pick results
-		batchPrice = nBatchPrice.value;
-		batchDelta = adjoints[nS0.idx];
-		transform(nVols.begin(), nVols.end(), batchVegas.begin(),
-			[&](const Number& vol) { return adjoints[vol.idx]; });
-
-		//	Accumulate
-		int paths = lastPath - firstPath;
-		double w = double(paths) / Np;
-		price += batchPrice * w;
-		delta += batchDelta * w;
-		transform(vegas.begin(), vegas.end(), batchVegas.begin(), vegas.begin(),
-			[&](const double& vega, const double& batchVega) { return vega + batchVega * w; });
-
-		//	Next batch
-		firstPath = lastPath;
-	}
+    vector<double> risks;
+    mcRisks(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        Np,
+        Nb,
+        random,
+        price,
+        risks);
+    dupireRisks(risks.data(), spots, times, delta, vegas);
 }
 
 inline double dupireBarrierPricerMT(
@@ -237,7 +240,7 @@ inline double dupireBarrierPricerMT(
     const double            strike,
     const double            barrier,
     //  Number of paths
-    const int				Np,
+    const long long			Np,
 	//	Number of simulations in every batch
 	const int				Nb,
 	//	Time steps
@@ -245,44 +248,100 @@ inline double dupireBarrierPricerMT(
     //  Smoothing
     const double            epsilon,
     //  Random number generator
-    RNG&					random)
+    RNG&					random,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{	
+    return mcSimulMT(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        Np,
+        Nb,
+        random);
+}
+
+//  Randomized QMC, see mcSimulRQMC
+inline void dupireBarrierPricerRQMC(
+    //  Spot
+    const double			S0,
+    //  Local volatility
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    const matrix<double>&   vols,
+    //  Product parameters
+    const double            maturity,
+    const double            strike,
+    const double            barrier,
+    //  Number of paths in every replication
+    const long long			Np,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Time steps
+    const int				Nt,
+    //  Smoothing
+    const double            epsilon,
+    //  Independent randomized RNGs, one per replication
+    const vector<unique_ptr<RNG>>&  randoms,
+	//	Results
+	double&					price,
+	double&					stdErr,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
 {	
-	//  Memory for the storage of batch-wise results
-    const int numBatches = int((Np - 1) / Nb) + 1;
-    vector<double> batchResults(numBatches);
-
-	//	Initialize the RNG
-	random.init(Nt);
-
-	//	Iterate over batches, in parallel
-	#pragma omp parallel for
-	for(int batch=0; batch<numBatches; ++batch)
-	{
-		const int firstPath = batch * Nb;
-		const int lastPath = min(firstPath + Nb, Np);
-
-        //  Make a copy of the (mutable) RNG
-        auto cRandom = random.clone();
-
-        //  Process the batch
-        batchResults[batch] = (lastPath - firstPath) 
-            * dupireBarrierMCBatch(
-                S0,
-                spots,
-                times,
-                vols,
-                maturity,
-                strike,
-                barrier,
-                firstPath,
-                lastPath,
-                Nt,
-                epsilon,
-                *cRandom);   //  call with own copy of RNG
-	}
-    
-    //  Average results over batches
-    return accumulate(batchResults.begin(), batchResults.end(), 0.0) / Np;
+    mcSimulRQMC(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        Np,
+        Nb,
+        randoms,
+        price,
+        stdErr);
+}
+
+//  Adaptive number of paths, see mcSimulAdaptive
+inline void dupireBarrierPricerAdaptive(
+    //  Spot
+    const double			S0,
+    //  Local volatility
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    const matrix<double>&   vols,
+    //  Product parameters
+    const double            maturity,
+    const double            strike,
+    const double            barrier,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Time steps
+    const int				Nt,
+    //  Smoothing
+    const double            epsilon,
+    //  Random number generator
+    RNG&					random,
+    //  Target standard error
+    const double            tolerance,
+    //  Maximum number of paths
+    const long long         maxPaths,
+    //  Time budget in seconds, 0 for none
+    const double            maxSeconds,
+	//	Results
+	double&					price,
+	double&					stdErr,
+    long long&              paths,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    mcSimulAdaptive(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        Nb,
+        random,
+        tolerance,
+        maxPaths,
+        maxSeconds,
+        price,
+        stdErr,
+        paths);
 }
 
 inline void dupireBarrierRisksMT(
@@ -297,7 +356,7 @@ inline void dupireBarrierRisksMT(
     const double            strike,
     const double            barrier,
     //  Number of paths
-    const int				Np,
+    const long long			Np,
 	//	Number of simulations in every batch
 	const int				Nb,
 	//	Time steps
@@ -309,99 +368,349 @@ inline void dupireBarrierRisksMT(
 	//	Results
 	double&					price,
 	double&					delta,
-	matrix<double>&			vegas)
+	matrix<double>&			vegas,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
 {	
-	//  Memory for the storage of batch-wise results
-    int numBatches = int((Np - 1) / Nb) + 1;
-    vector<double> batchPrices(numBatches);
-    vector<double> batchDeltas(numBatches);
-    vector<matrix<double>> batchVegas(numBatches);
-    for (auto& batchVega : batchVegas)
+    vector<double> risks;
+    mcRisksMT(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        Np,
+        Nb,
+        random,
+        price,
+        risks);
+    dupireRisks(risks.data(), spots, times, delta, vegas);
+}
+
+//  Multilevel Monte-Carlo, see mcSimulMLMC
+//  Level l monitors the barrier on Nt x 2^l dates, with the same smoothing, up to Nt x 2^(levels - 1)
+inline void dupireBarrierPricerMLMC(
+    //  Spot
+    const double			S0,
+    //  Local volatility
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    const matrix<double>&   vols,
+    //  Product parameters
+    const double            maturity,
+    const double            strike,
+    const double            barrier,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Time steps on the coarsest level
+    const int				Nt,
+    //  Maximum number of levels
+    const int               levels,
+    //  Smoothing
+    const double            epsilon,
+    //  Random number generator
+    RNG&					random,
+    //  Target root mean square error
+    const double            tolerance,
+    //  Maximum number of paths on every level
+    const long long         maxPaths,
+	//	Results
+	double&					price,
+	double&					stdErr,
+    vector<long long>&      paths,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    vector<BarrierOption<double>> levelProducts;
+    for (int l = 0; l < levels; ++l)
     {
-	    batchVega.resize(spots.size(), times.size());
+        levelProducts.emplace_back(maturity, strike, barrier, epsilon, Nt << l, continuous);
     }
 
-	//	Initialize the RNG
-	random.init(Nt);
-	 
-	//	Iterate over batches, in parallel
-	#pragma omp parallel for
-	for(int batch=0; batch<numBatches; ++batch)
-	{
-		const int firstPath = batch * Nb;
-		const int lastPath = min(firstPath + Nb, Np);
-
-        //  Make a copy of the (mutable) RNG
-        auto cRandom = random.clone();
-
-        //	Wipe the tape
-        tape.clear();
-
-        //	Put parameters on tape by initialization of Number types
-        
-		//	Working memory
-		static thread_local Number nS0, nMaturity, nStrike, nBarrier, nEpsilon;
-        static thread_local vector<Number> nSpots, nTimes;
-        static thread_local matrix<Number> nVols;
-
-		//	Allocate
-		nSpots.resize(spots.size()); 
-		nTimes.resize(times.size());
-		nVols.resize(vols.rows(), vols.cols());
-
-		//	Initialize and put on tape
-		nS0 = S0;
-        nMaturity = maturity;
-        nStrike = strike;
-        nBarrier = barrier;
-        nEpsilon = epsilon;
-        copy(spots.begin(), spots.end(), nSpots.begin());
-        copy(times.begin(), times.end(), nTimes.begin());
-        copy(vols.begin(), vols.end(), nVols.begin());
-
-        //	Process the batch
-        Number nBatchPrice = dupireBarrierMCBatch(
-            nS0,
-            nSpots,
-            nTimes,
-            nVols,
-            nMaturity,
-            nStrike,
-            nBarrier,
-            firstPath,
-            lastPath,
-            Nt,
-            nEpsilon,
-            *cRandom);
-
-        //	Back-propagate derivatives
-        vector<double> adjoints = calculateAdjoints(nBatchPrice);
-
-        //	Pick results
-        int paths = lastPath - firstPath;
-        batchPrices[batch] = nBatchPrice.value * paths;
-        batchDeltas[batch] = adjoints[nS0.idx] * paths;
-        transform(nVols.begin(), nVols.end(), batchVegas[batch].begin(),
-            [&](const Number& vol) { return adjoints[vol.idx] * paths; });
-
-	}
-
-    //  Average results over batches
-    price = accumulate(batchPrices.begin(), batchPrices.end(), 0.0) / Np;
-    delta = accumulate(batchDeltas.begin(), batchDeltas.end(), 0.0) / Np;    
-    vegas.resize(spots.size(), times.size());
-    for (auto& vega : vegas) vega = 0.0;
-	//	Average vegas in parallel
-	#pragma omp parallel for
-	for (int i = 0; i < vegas.rows(); ++i)
-	{
-		for (int j = 0; j < vegas.cols(); ++j)
-		{
-			for (int k = 0; k < numBatches; ++k)
-			{
-				vegas[i][j] += batchVegas[k][i][j];
-			}
-			vegas[i][j] /= Np;
-		}
-	}
+    mcSimulMLMC(
+        DupireModel<double>(S0, spots, times, vols),
+        levelProducts,
+        Nb,
+        random,
+        tolerance,
+        maxPaths,
+        price,
+        stdErr,
+        paths);
+}
+
+//  Control variates, see mcSimulCV
+//  The controls are European calls struck at the strike and at the barrier, in the Black-Scholes model of DupireModel::controlModel:
+//      the up-and-out call is close to the call spread minus a digital at the barrier, so both calls are strongly correlated with it
+//  With continuous monitoring, the up-and-out call itself is a third control, monitored with the Brownian bridge on the same dates,
+//      which is exact in Black-Scholes, so its mean is the closed form of BlackScholes.h
+//  With discrete smoothed monitoring, its mean differs from the closed form, which would bias the estimate
+inline vector<EuropeanCall<double>> barrierControls(
+    const double            maturity,
+    const double            strike,
+    const double            barrier,
+    const int               Nt,
+    const bool              continuous)
+{
+    vector<EuropeanCall<double>> controls = { EuropeanCall<double>(maturity, strike), EuropeanCall<double>(maturity, barrier) };
+    if (continuous) controls.emplace_back(maturity, strike, barrier, Nt);
+    return controls;
+}
+
+inline void dupireBarrierPricerCV(
+    //  Spot
+    const double			S0,
+    //  Local volatility
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    const matrix<double>&   vols,
+    //  Product parameters
+    const double            maturity,
+    const double            strike,
+    const double            barrier,
+    //  Number of paths
+    const long long			Np,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Time steps
+    const int				Nt,
+    //  Smoothing
+    const double            epsilon,
+    //  Random number generator
+    RNG&					random,
+	//	Results
+	double&					price,
+	double&					stdErr,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    mcSimulCV(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        barrierControls(maturity, strike, barrier, Nt, continuous),
+        Np,
+        Nb,
+        random,
+        price,
+        stdErr);
+}
+
+inline void dupireBarrierRisksCV(
+    //  Spot
+    const double			S0,
+    //  Local volatility
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    const matrix<double>&   vols,
+    //  Product parameters
+    const double            maturity,
+    const double            strike,
+    const double            barrier,
+    //  Number of paths
+    const long long			Np,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Time steps
+    const int				Nt,
+    //  Smoothing
+    const double            epsilon,
+    //  Random number generator
+    RNG&					random,
+	//	Results
+	double&					price,
+	double&					stdErr,
+	double&					delta,
+	matrix<double>&			vegas,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    vector<double> risks;
+    mcRisksCV(
+        DupireModel<double>(S0, spots, times, vols),
+        BarrierOption<double>(maturity, strike, barrier, epsilon, Nt, continuous),
+        barrierControls(maturity, strike, barrier, Nt, continuous),
+        Np,
+        Nb,
+        random,
+        price,
+        stdErr,
+        risks);
+    dupireRisks(risks.data(), spots, times, delta, vegas);
+}
+
+//  Books of barrier options, with different maturities, strikes and barriers,
+//      all priced on the same paths, simulated on the merged timeline of the options, see mcEngine.h
+
+//  The options of a book
+inline vector<BarrierOption<double>> barrierOptions(
+    const vector<double>&   maturities,
+    const vector<double>&   strikes,
+    const vector<double>&   barriers,
+    const int               Nt,
+    const double            epsilon,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    if (strikes.size() != maturities.size() || barriers.size() != maturities.size())
+    {
+        throw runtime_error("barrierOptions: maturities, strikes and barriers must have the same size");
+    }
+
+    vector<BarrierOption<double>> options;
+    options.reserve(maturities.size());
+    for (size_t k = 0; k < maturities.size(); ++k)
+    {
+        options.emplace_back(maturities[k], strikes[k], barriers[k], epsilon, Nt, continuous);
+    }
+    return options;
+}
+
+//  Prices of a book, in parallel
+inline vector<double> dupireBarriersPricerMT(
+    //  Spot
+    const double			S0,
+    //  Local volatility
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    const matrix<double>&   vols,
+    //  Products parameters, by product
+    const vector<double>&   maturities,
+    const vector<double>&   strikes,
+    const vector<double>&   barriers,
+    //  Number of paths
+    const long long			Np,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Monitoring dates of every product
+    const int				Nt,
+    //  Smoothing
+    const double            epsilon,
+    //  Random number generator
+    RNG&					random,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    return mcSimulMT(
+        DupireModel<double>(S0, spots, times, vols),
+        barrierOptions(maturities, strikes, barriers, Nt, epsilon, continuous),
+        Np,
+        Nb,
+        random);
+}
+
+//  Prices and risks of a book, in parallel, with one multi-adjoint sweep per batch
+inline void dupireBarriersRisksMT(
+    //  Spot
+    const double			S0,
+    //  Local volatility
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    const matrix<double>&   vols,
+    //  Products parameters, by product
+    const vector<double>&   maturities,
+    const vector<double>&   strikes,
+    const vector<double>&   barriers,
+    //  Number of paths
+    const long long			Np,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Monitoring dates of every product
+    const int				Nt,
+    //  Smoothing
+    const double            epsilon,
+    //  Random number generator
+    RNG&					random,
+	//	Results, by product
+	vector<double>&			prices,
+	vector<double>&			deltas,
+	vector<matrix<double>>&	vegas,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    matrix<double> risks;
+    mcRisksMT(
+        DupireModel<double>(S0, spots, times, vols),
+        barrierOptions(maturities, strikes, barriers, Nt, epsilon, continuous),
+        Np,
+        Nb,
+        random,
+        prices,
+        risks);
+
+    const size_t numProducts = prices.size();
+    deltas.resize(numProducts);
+    vegas.resize(numProducts);
+    for (size_t k = 0; k < numProducts; ++k)
+    {
+        dupireRisks(risks[k], spots, times, deltas[k], vegas[k]);
+    }
+}
+
+//  Risks against market implied vols
+//  The local vols are built out of the implied vols with dupireLocalVols,
+//      the risks against local vols are computed in parallel with dupireBarrierRisksMT,
+//      then back-propagated through the construction of the local vols:
+//      a single adjoint sweep over the (small) tape of the construction
+//  The delta includes the effect of the spot on the local vols, with implied vols by strike held constant
+inline void dupireBarrierRisksImplied(
+    //  Spot
+    const double			S0,
+    //  Market implied vols, strikes in rows, maturities in columns
+    const vector<double>&   strikes,
+    const vector<double>&   mats,
+    const matrix<double>&   impliedVols,
+    //  Local volatility grid
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    //  Product parameters
+    const double            maturity,
+    const double            strike,
+    const double            barrier,
+    //  Number of paths
+    const long long			Np,
+	//	Number of simulations in every batch
+	const int				Nb,
+	//	Time steps
+    const int				Nt,
+    //  Smoothing
+    const double            epsilon,
+    //  Random number generator
+    RNG&					random,
+	//	Results
+	double&					price,
+	double&					delta,
+	matrix<double>&			vegas,
+    //  Continuous monitoring, see BarrierOption
+    const bool              continuous = false)
+{
+    //  Local vols
+    matrix<double> vols;
+    dupireLocalVols(S0, strikes, mats, impliedVols, spots, times, vols);
+
+    //  Risks against local vols
+    double localDelta;
+    matrix<double> localVegas;
+    dupireBarrierRisksMT(S0, spots, times, vols, maturity, strike, barrier, Np, Nb, Nt, epsilon, random,
+        price, localDelta, localVegas, continuous);
+
+    //  Record the construction of the local vols
+    tape.clear();
+    Number nS0 = S0;
+    matrix<Number> nImpliedVols(impliedVols);
+    matrix<Number> nVols;
+    dupireLocalVols(nS0, strikes, mats, nImpliedVols, spots, times, nVols);
+
+    //  The adjoints of the scalar product of local vols with local vegas are the chained risks
+    Number dot = 0.0;
+    for (size_t i = 0; i < nVols.rows(); ++i) for (size_t j = 0; j < nVols.cols(); ++j)
+    {
+        dot += nVols[i][j] * localVegas[i][j];
+    }
+    vector<double> adjoints = calculateAdjoints(dot);
+
+    //  Pick results
+    delta = localDelta + adjoints[nS0.idx];
+    vegas.resize(impliedVols.rows(), impliedVols.cols());
+    transform(nImpliedVols.begin(), nImpliedVols.end(), vegas.begin(),
+        [&](const Number& vol) { return adjoints[vol.idx]; });
+
+    //  Wipe the tape
+    tape.clear();
 }
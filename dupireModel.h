@@ -0,0 +1,170 @@
+#pragma once
+
+//  Dupire's local volatility model, for the generic Monte-Carlo engine of mcEngine.h
+//  ===============================================================================
+
+//  The spot follows dS/S = sigma(S, t) dW, with zero rates and dividends,
+//      with local volatilities given on a grid of spots and times,
+//      interpolated linearly in both dimensions, extrapolated flat
+//  Simulated with log-Euler steps between the event dates of the timeline,
+//      the vol is interpolated at the start of every step,
+//      for all paths at once, since the time is the same on all paths at a given step
+
+#include "matrix.h"
+#include "interp.h"
+#include "blackScholesModel.h"
+
+#include <memory>
+#include <type_traits>
+#include <stdexcept>
+
+template <class T>
+class DupireModel
+{
+    //  Parameters
+    T                   myS0;
+    vector<double>      mySpots;
+    vector<double>      myTimes;
+    //  Spots in rows, times in columns
+    matrix<T>           myVols;
+
+    //  Simulation, set by init
+    vector<double>      myDts;
+    vector<double>      mySqrtDts;
+    size_t              myNumSteps = 0;
+    //  The vol surface interpolated in time on the starts of the steps, immutable once built, so shared by copies
+    shared_ptr<const interp2DSlices<double, T>>    myVolSurface;
+
+    template <class U> friend class DupireModel;
+
+public:
+
+    DupireModel(
+        const T&                S0,
+        const vector<double>&   spots,
+        const vector<double>&   times,
+        const matrix<T>&        vols)
+        : myS0(S0), mySpots(spots), myTimes(times), myVols(vols)
+    {
+        if (vols.rows() != spots.size() || vols.cols() != times.size())
+        {
+            throw runtime_error("DupireModel: vols must be spots x times");
+        }
+    }
+
+    //  Conversion, puts the parameters on tape with T = Number, the simulation must be initialized again
+    template <class U>
+    DupireModel(const DupireModel<U>& rhs)
+        : myS0(rhs.myS0), mySpots(rhs.mySpots), myTimes(rhs.myTimes), myVols(rhs.myVols) {}
+
+    const T& S0() const { return myS0; }
+    const vector<double>& spots() const { return mySpots; }
+    const vector<double>& times() const { return myTimes; }
+    const matrix<T>& vols() const { return myVols; }
+
+    //  Steps between the event dates, starting today
+    //  Today as an event date is not a step: its spot is S0 and it consumes no Gaussian
+    void init(const vector<double>& timeline)
+    {
+        const size_t n = timeline.size();
+        vector<double> stepTimes(n);
+        myDts.resize(n);
+        mySqrtDts.resize(n);
+        myNumSteps = 0;
+
+        double t = 0.0;
+        for (size_t j = 0; j < n; ++j)
+        {
+            stepTimes[j] = t;
+            myDts[j] = timeline[j] - t;
+            mySqrtDts[j] = sqrt(myDts[j]);
+            if (myDts[j] > 0.0) ++myNumSteps;
+            t = timeline[j];
+        }
+
+        myVolSurface = make_shared<const interp2DSlices<double, T>>(mySpots, myTimes, myVols, stepTimes);
+    }
+
+    //  One Gaussian per step of positive length
+    size_t simDim() const { return myNumSteps; }
+
+    //  Step by step, all paths in the block
+    //  With doubles, the loops over the paths are free of branches and vectorize,
+    //      including the interpolation of the vol surface (on a uniform grid of spots) and exp
+    //      (with a vectorized math library, like SVML with Visual Studio /O2 /arch:AVX2)
+    void generatePaths(const matrix<double>& gaussians, matrix<T>& paths, matrix<T>* variances, const size_t n) const
+    {
+        const interp2DSlices<double, T>& volSurface = *myVolSurface;
+        static thread_local vector<T> vol;
+        vol.resize(n);
+
+        size_t g = 0;
+        for (size_t j = 0; j < myDts.size(); ++j)
+        {
+            //  Start of the step
+            T* spot = paths[j];
+            if (j) copy(paths[j - 1], paths[j - 1] + n, spot);
+            else fill(spot, spot + n, myS0);
+
+            T* var = variances ? (*variances)[j] : nullptr;
+            if (var)
+            {
+                if (j) copy((*variances)[j - 1], (*variances)[j - 1] + n, var);
+                else fill(var, var + n, T(0.0));
+            }
+
+            //  No step today
+            if (myDts[j] <= 0.0) continue;
+
+            //  Interpolate volatility
+            if constexpr (is_same<T, double>::value)
+            {
+                volSurface(j, spot, vol.data(), n);
+            }
+            else
+            {
+                for (size_t p = 0; p < n; ++p) vol[p] = volSurface(j, spot[p]);
+            }
+
+            //  Simulate returns
+            const double* z = gaussians[g++];
+            const double dt = myDts[j], sdt = mySqrtDts[j];
+            for (size_t p = 0; p < n; ++p)
+            {
+                spot[p] *= exp(-0.5 * vol[p] * vol[p] * dt + vol[p] * sdt * z[p]);
+            }
+
+            //  Integrate variance, with the vol of the step
+            if (var)
+            {
+                for (size_t p = 0; p < n; ++p) var[p] += vol[p] * vol[p] * dt;
+            }
+        }
+    }
+
+    //  Black-Scholes model driven by the same Gaussians, for control variates, see mcSimulCV
+    //  Same spot, and the local vol at the spot, averaged in variance over the steps, after init
+    //  With T = Number, the vol is on tape, a function of the local vols, so risks flow through the control model
+    BlackScholesModel<T> controlModel() const
+    {
+        T var(0.0);
+        double mat = 0.0;
+        for (size_t j = 0; j < myDts.size(); ++j)
+        {
+            const T vol = (*myVolSurface)(j, myS0);
+            var += vol * vol * myDts[j];
+            mat += myDts[j];
+        }
+        return BlackScholesModel<T>(myS0, mat > 0.0 ? sqrt(var / mat) : T(0.0));
+    }
+
+    //  Spot, then local vols, spots major, like the iterators of matrix
+    vector<T*> parameters()
+    {
+        vector<T*> params;
+        params.reserve(1 + myVols.rows() * myVols.cols());
+        params.push_back(&myS0);
+        for (auto& vol : myVols) params.push_back(&vol);
+        return params;
+    }
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+//  Pre-generated Gaussian numbers, for repeated pricings
+//  =====================================================
+
+//  When we price the same product under many scenarios (vol surfaces, bumps),
+//      we regenerate the same Gaussian numbers every time
+//  Instead, we generate Np x dim Gaussians once in memory, 
+//      and replay them with ReplayRNG, without copy, 
+//      effectively removing the RNG from the simulation loop
+//  The cache is immutable after construction, 
+//      so it is shared read-only across threads and pricings with a shared_ptr
+
+#include "random.h"
+#include "threadPool.h"
+
+#include <stdexcept>
+
+class GaussianCache
+{
+    //  Number of paths and dimension
+    size_t              myNp;
+    size_t              myDim;
+
+    //  Numbers, path by path: path i starts at i * myDim
+    vector<double>      myNumbers;
+
+public:
+
+    //  Generates Np paths of dimension dim with a copy of rng
+    //  In parallel on the thread pool, in batches, with the same skip ahead logic as the parallel pricers,
+    //      so the cache contains the exact same numbers as a direct simulation
+    //  Exceptions thrown by the RNG, for instance on skip ahead, are rethrown to the caller
+    GaussianCache(
+        const RNG&      rng,
+        const size_t    Np,
+        const size_t    dim,
+        const size_t    batchSize = 1024) :
+        myNp(Np),
+        myDim(dim),
+        myNumbers(Np * dim)
+    {
+        auto random = rng.clone();
+        random->init(dim);
+
+        const size_t numBatches = Np ? (Np - 1) / batchSize + 1 : 0;
+
+        ThreadPool::instance().parallelFor(numBatches, [&](const size_t batch, const size_t)
+        {
+            const size_t firstPath = batch * batchSize;
+            const size_t lastPath = min(firstPath + batchSize, Np);
+
+            //  Own copy of the RNG
+            auto cRandom = random->clone();
+            cRandom->skipTo(firstPath);
+
+            vector<double> gaussians(dim);
+            for (size_t i = firstPath; i < lastPath; ++i)
+            {
+                cRandom->nextG(gaussians);
+                copy(gaussians.begin(), gaussians.end(), myNumbers.begin() + i * dim);
+            }
+        });
+    }
+
+    size_t paths() const { return myNp; }
+    size_t dim() const { return myDim; }
+
+    //  Gaussians of path i
+    const double* operator[](const size_t i) const { return &myNumbers[i * myDim]; }
+};
+
+//  Replays a cache, implements the RNG interface
+class ReplayRNG : public RNG
+{
+    //  Shared, read-only
+    shared_ptr<const GaussianCache>     myCache;
+
+    //  Dimension
+    size_t                              myDim;
+
+    //  Current path
+    unsigned long long                  myPath;
+
+    //  Check that we don't read beyond the cache
+    void check() const
+    {
+        if (myPath >= myCache->paths())
+        {
+            throw runtime_error("ReplayRNG: path beyond the end of the cache");
+        }
+    }
+
+public:
+
+    explicit ReplayRNG(shared_ptr<const GaussianCache> cache) :
+        myCache(move(cache)), myDim(0), myPath(0) {}
+
+    //  Virtual copy constructor: copies the pointer, not the cache
+    unique_ptr<RNG> clone() const override
+    {
+        return make_unique<ReplayRNG>(*this);
+    }
+
+    //  Initializer, the dimension must not exceed the dimension of the cache
+    void init(const size_t simDim) override
+    {
+        if (simDim > myCache->dim())
+        {
+            throw runtime_error("ReplayRNG: dimension exceeds the dimension of the cache");
+        }
+
+        myDim = simDim;
+        myPath = 0;
+    }
+
+    //  Only Gaussians are cached
+    void nextU(vector<double>&) override
+    {
+        throw runtime_error("ReplayRNG: uniforms are not cached");
+    }
+
+    void nextG(vector<double>& gaussVec) override
+    {
+        const double* gaussians = nextGPtr(gaussVec);
+        copy(gaussians, gaussians + myDim, gaussVec.begin());
+    }
+
+    //  No copy: points directly in the cache
+    const double* nextGPtr(vector<double>&) override
+    {
+        check();
+        return (*myCache)[size_t(myPath++)];
+    }
+
+    //  Skip ahead: free
+    void skipTo(const unsigned long long b) override
+    {
+        myPath = b;
+    }
+};
@@ -10,20 +10,19 @@ using namespace std;
 //  Gaussian functions
 
 //  Normal density
+//  No branch: exp underflows to 0 gracefully in the tails
 inline double normalDens(const double x)
 {
-    return x<-10.0 || 10.0<x ? 0.0 : exp(-0.5*x*x) / 2.506628274631;
+    return exp(-0.5*x*x) / 2.506628274631;
 }
 
 //	Normal CDF (N in Black-Scholes)
-//  Zelen and Severo's approximation (1964)
+//  Zelen and Severo's approximation (1964), accurate to around 1e-7
 //  See https://en.wikipedia.org/wiki/Normal_distribution#Numerical_approximations_for_the_normal_CDF
+//  We compute the tail Q = 1 - N(|x|) and reflect N(-x) = 1 - N(x), without recursion, 
+//      so the only branch is a select that compilers vectorize
 inline double normalCdf(const double x)
 {
-	if (x < -10.0) return 0.0;
-	if (x > 10.0) return 1.0;
-    if (x < 0.0) return 1.0 - normalCdf(-x);
-
 	static constexpr double p = 0.2316419;
 	static constexpr double b1 = 0.319381530;
 	static constexpr double b2 = -0.356563782;
@@ -31,13 +30,50 @@ inline double normalCdf(const double x)
 	static constexpr double b4 = -1.821255978;
 	static constexpr double b5 = 1.330274429;
 
-	const auto t = 1.0 / (1.0 + p*x);
+    const auto ax = fabs(x);
+
+	const auto t = 1.0 / (1.0 + p*ax);
 
     const auto pol = t*(b1 + t*(b2 + t*(b3 + t*(b4 + t*b5))));
 
-    const auto pdf = normalDens(x);
+    const auto tail = normalDens(ax) * pol;
+
+	return x < 0.0 ? tail : 1.0 - tail;
+}
 
-	return 1.0 - pdf * pol;
+//  Normal CDF from the complementary error function, accurate to machine precision
+//  N(x) = erfc(-x / sqrt(2)) / 2
+inline double normalCdfAccurate(const double x)
+{
+    static constexpr double invSqrt2 = 0.70710678118654752440;
+    return 0.5 * erfc(-invSqrt2 * x);
+}
+
+//  Array versions, res[i] = N(x[i]) or n(x[i]) for i = 0 to n - 1
+//  Loop bodies are branch-free, so compilers vectorize them
+//  accurate = true for the erfc based CDF
+template <bool accurate = false>
+inline void normalCdf(const double* x, double* res, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if constexpr (accurate)
+        {
+            res[i] = normalCdfAccurate(x[i]);
+        }
+        else
+        {
+            res[i] = normalCdf(x[i]);
+        }
+    }
+}
+
+inline void normalDens(const double* x, double* res, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        res[i] = normalDens(x[i]);
+    }
 }
 
 //	Inverse CDF (for generation of Gaussians out of Uniforms)
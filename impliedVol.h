@@ -0,0 +1,182 @@
+#pragma once
+
+//  Implied volatility
+//  ==================
+
+//  Inverts blackScholes for a batch of call prices given in structure of arrays,
+//      in parallel over chunks of options, with vectorizable loops over the chunk
+
+//  The price is normalized into the out-of-the-money option
+//      b(x, s) = exp(x/2) N(x/s + s/2) - exp(-x/2) N(x/s - s/2), with x = log(fwd/strike) <= 0
+//      and s = vol * sqrt(mat), see Jaeckel, Let's Be Rational, Wilmott, 2015
+//  b is convex in s below the inflection point sc = sqrt(2|x|) and concave above, so:
+//      above sc, we iterate on b as a function of s,
+//          from the guess of the ATM-like asymptotic b ~ exp(x/2) - (exp(x/2) + exp(-x/2)) N(-s/2)
+//      below sc, we iterate on log(b) as a function of log(s), which is close to linear,
+//          from the guess of the asymptotic log(b) ~ -x^2/2s^2 + 3 log(s) - 2 log|x| - log(2pi)/2
+//  Iterations are third order Householder steps, using the closed form derivatives of b:
+//      b' = exp(x/2) n(x/s + s/2), b''/b' = x^2/s^3 - s/4, b'''/b' = (b''/b')^2 - 3x^2/s^4 - 1/4
+//      with a bracket to reject steps that fall out of the current bracket
+//  A fixed number of iterations, so all options in a chunk run the same code,
+//      the default 4 reaches a relative accuracy of 1e-12 (close to the precision of the normalized price)
+//      for x in [-10, 0], s in [0.001, 8] and normalized prices above 1e-12
+//  Deep in the money, the accuracy is limited by the cancellation in put-call parity
+
+#include "BlackScholes.h"
+
+#include <limits>
+
+template <bool accurate = true>
+inline void impliedVolBatch(
+    //  Number of options
+    const size_t        n,
+    //  Inputs, arrays of n
+    const double*       price,      //  of calls
+    const double*       spot,
+    const double*       rate,
+    const double*       yield,
+    const double*       strike,
+    const double*       mat,
+    //  Results, array of n
+    //  NaN when the price is out of the no-arbitrage bounds, 0 at the intrinsic value
+    double*             vol,
+    //  Number of iterations
+    const size_t        iterations = 4)
+{
+    constexpr size_t chunk = 256;
+    const long long numChunks = n ? (long long)((n - 1) / chunk) + 1 : 0;
+
+    constexpr double infinity = numeric_limits<double>::max();
+    constexpr double halfLog2Pi = 0.91893853320467274;  //  log(2pi) / 2
+
+    #pragma omp parallel for
+    for (long long c = 0; c < numChunks; ++c)
+    {
+        const size_t first = size_t(c) * chunk;
+        const size_t m = min(chunk, n - first);
+
+        //  Working memory, on the stack
+        double x[chunk], ex[chunk], beta[chunk], s[chunk], lo[chunk], hi[chunk];
+        double d1[chunk], d2[chunk], p1[chunk], p2[chunk], n1[chunk];
+        bool lower[chunk], valid[chunk], atIntrinsic[chunk];
+
+        //  Normalization into out-of-the-money options
+        for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            const double df = exp(-rate[k] * mat[k]),
+                fwd = spot[k] * exp((rate[k] - yield[k]) * mat[k]);
+            const double xx = log(fwd / strike[k]);
+            const double eh = exp(0.5 * xx);
+            double b = price[k] / (df * sqrt(fwd * strike[k]));
+            //  In the money: put-call parity, the put is the call with -x
+            if (xx > 0.0) b -= eh - 1.0 / eh;
+            x[i] = -fabs(xx);
+            ex[i] = exp(0.5 * x[i]);
+            //  Outside of the bounds, solve a dummy problem and discard
+            valid[i] = b > 0.0 && b < ex[i];
+            //  Up to rounding in put-call parity
+            atIntrinsic[i] = b <= 0.0 && b > -1.0e-14 * max(eh, 1.0);
+            beta[i] = valid[i] ? b : 0.5 * ex[i];
+        }
+
+        //  Branch, bracket and initial guess
+        for (size_t i = 0; i < m; ++i)
+        {
+            const double ax = -x[i];
+            const double sc = sqrt(2.0 * ax);
+            //  At sc, d1 = 0 and d2 = -sc
+            const double bc = 0.5 * ex[i] - normalCdfAccurate(-sc) / ex[i];
+            lower[i] = beta[i] < bc;
+
+            if (lower[i])
+            {
+                const double lb = log(beta[i]);
+                double sl = ax / sqrt(-2.0 * lb);
+                for (int j = 0; j < 3; ++j)
+                {
+                    const double r = -2.0 * (lb - 3.0 * log(sl) + 2.0 * log(ax) + halfLog2Pi);
+                    if (r > 0.0) sl = ax / sqrt(r);
+                }
+                s[i] = min(sl, sc);
+                lo[i] = 0.0;
+                hi[i] = sc;
+            }
+            else
+            {
+                const double q = (ex[i] - beta[i]) / (ex[i] + 1.0 / ex[i]);
+                s[i] = max(-2.0 * invNormalCdf(q), sc);
+                lo[i] = sc;
+                hi[i] = infinity;
+            }
+        }
+
+        //  Iterations
+        for (size_t it = 0; it < iterations; ++it)
+        {
+            for (size_t i = 0; i < m; ++i)
+            {
+                d1[i] = x[i] / s[i] + 0.5 * s[i];
+                d2[i] = d1[i] - s[i];
+            }
+
+            normalCdf<accurate>(d1, p1, m);
+            normalCdf<accurate>(d2, p2, m);
+            normalDens(d1, n1, m);
+
+            for (size_t i = 0; i < m; ++i)
+            {
+                const double si = s[i], x2 = x[i] * x[i];
+                const double b = ex[i] * p1[i] - p2[i] / ex[i];
+                const double db = ex[i] * n1[i];
+
+                //  Bracket
+                if (b > beta[i]) hi[i] = si;
+                else lo[i] = si;
+
+                //  b''/b' and b'''/b'
+                const double h2 = x2 / (si * si * si) - 0.25 * si;
+                const double h3 = h2 * h2 - 3.0 * x2 / (si * si * si * si) - 0.25;
+
+                //  Newton step and ratios of derivatives of the objective
+                double nu, H2, H3;
+                if (lower[i])
+                {
+                    //  log(b) in log(s)
+                    const double l1 = db / b;
+                    nu = log(b / beta[i]) / (si * l1);
+                    H2 = 1.0 + si * (h2 - l1);
+                    H3 = 1.0 + 3.0 * si * (h2 - l1) + si * si * (h3 - 3.0 * h2 * l1 + 2.0 * l1 * l1);
+                }
+                else
+                {
+                    //  b in s
+                    nu = (b - beta[i]) / db;
+                    H2 = h2;
+                    H3 = h3;
+                }
+
+                //  Householder
+                const double step = nu * (1.0 - 0.5 * H2 * nu) / (1.0 - H2 * nu + H3 * nu * nu / 6.0);
+                double sn = lower[i] ? si * exp(-step) : si - step;
+
+                //  Safeguard, also catches NaNs
+                if (!(sn >= lo[i] && sn <= hi[i]))
+                {
+                    sn = hi[i] < infinity
+                        ? (lo[i] > 0.0 ? sqrt(lo[i] * hi[i]) : 0.5 * hi[i])
+                        : 2.0 * si;
+                }
+                s[i] = sn;
+            }
+        }
+
+        //  Results
+        for (size_t i = 0; i < m; ++i)
+        {
+            const size_t k = first + i;
+            vol[k] = valid[i] ? s[i] / sqrt(mat[k])
+                : atIntrinsic[i] ? 0.0 : numeric_limits<double>::quiet_NaN();
+        }
+    }
+}
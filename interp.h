@@ -17,6 +17,8 @@ As long as this comment is preserved at the top of the file
 #pragma once
 
 #include <algorithm>
+#include <type_traits>
+#include <math.h>
 #include "matrix.h"
 using namespace std;
 
@@ -108,3 +110,366 @@ inline V interp2D(
         return z1 + (z2 - z1) * t;;
     }
 }
+
+//  Value of a number, the number itself for doubles, 
+//      the value field of AAD numbers
+inline double valueOf(const double x) { return x; }
+template <class T>
+inline double valueOf(const T& x) { return x.value; }
+
+//  Interpolation on a fixed grid of knots
+//  On uniform and log-uniform grids, the bracket is found with arithmetic in constant time,
+//      otherwise with a binary search, like interp
+//  The kind of grid is detected on construction or declared by the caller
+//  Results are identical to interp (the arithmetic index is corrected against the knots)
+template <class T>
+class interpGrid
+{
+public:
+
+    enum class Kind { general, uniform, logUniform };
+
+private:
+
+    //  Knots, copied
+    vector<T>           myX;
+    size_t              myN;
+    Kind                myKind;
+
+    //  x = x0 + k * h, or log(x) = log(x0) + k * h
+    double              myX0;
+    double              myInvH;
+
+public:
+
+    //  Arithmetic index of the knot below x0, not clamped, uniform and log-uniform grids only
+    double arithmeticIdx(const double x0) const
+    {
+        return myKind == Kind::uniform 
+            ? (x0 - myX0) * myInvH 
+            : log(x0 / myX0) * myInvH;
+    }
+
+    //  Detect the kind of grid
+    explicit interpGrid(const vector<T>& x) : myX(x), myN(x.size()), myKind(Kind::general), myX0(0.0), myInvH(0.0)
+    {
+        if (myN < 3) return;
+
+        const double x0 = valueOf(x[0]), xn = valueOf(x[myN - 1]);
+
+        //  Relative tolerance on the grid step, the arithmetic index is then off by at most one
+        constexpr double tol = 1.0e-10;
+
+        //  Uniform?
+        const double h = (xn - x0) / (myN - 1);
+        bool uniform = h > 0.0;
+        for (size_t i = 1; uniform && i < myN - 1; ++i)
+        {
+            uniform = fabs(valueOf(x[i]) - (x0 + i * h)) <= tol * h;
+        }
+        if (uniform)
+        {
+            myKind = Kind::uniform;
+            myX0 = x0;
+            myInvH = 1.0 / h;
+            return;
+        }
+
+        //  Log-uniform?
+        if (x0 <= 0.0) return;
+        const double lh = log(xn / x0) / (myN - 1);
+        bool logUniform = lh > 0.0;
+        for (size_t i = 1; logUniform && i < myN - 1; ++i)
+        {
+            logUniform = fabs(log(valueOf(x[i]) / x0) - i * lh) <= tol * lh;
+        }
+        if (logUniform)
+        {
+            myKind = Kind::logUniform;
+            myX0 = x0;
+            myInvH = 1.0 / lh;
+        }
+    }
+
+    //  Declare the kind of grid, the knots must be consistent
+    interpGrid(const vector<T>& x, const Kind kind) : myX(x), myN(x.size()), myKind(myN >= 2 ? kind : Kind::general), myX0(0.0), myInvH(0.0)
+    {
+        if (myKind == Kind::general) return;
+        myX0 = valueOf(x[0]);
+        myInvH = myKind == Kind::uniform
+            ? (myN - 1) / (valueOf(x[myN - 1]) - myX0)
+            : (myN - 1) / log(valueOf(x[myN - 1]) / myX0);
+    }
+
+    Kind kind() const { return myKind; }
+    size_t size() const { return myN; }
+    const vector<T>& knots() const { return myX; }
+
+    //  Index of the first knot greater than x0, like upper_bound
+    size_t upperBound(const double x0) const
+    {
+        if (myKind == Kind::general)
+        {
+            return distance(myX.begin(), upper_bound(myX.begin(), myX.end(), x0,
+                [](const double a, const T& b) { return a < valueOf(b); }));
+        }
+
+        //  Extrapolation, also catches log of non positive numbers
+        if (!(x0 >= valueOf(myX[0]))) return 0;
+        if (x0 >= valueOf(myX[myN - 1])) return myN;
+
+        //  Arithmetic, then corrected against the knots
+        size_t n = size_t(min(max(arithmeticIdx(x0), 0.0), double(myN - 2))) + 1;
+        if (x0 < valueOf(myX[n - 1])) --n;
+        else if (x0 >= valueOf(myX[n])) ++n;
+        return n;
+    }
+
+    //  Interpolates the values y on the knots in x0
+    template <bool smoothStep=false, class ITY, class X>
+    auto operator()(ITY y, const X& x0) const
+        ->remove_const_t<remove_reference_t<decltype(*y)>>
+    {
+        const size_t n2 = upperBound(valueOf(x0));
+
+        //  Extrapolation?
+        if (n2 == myN) return y[myN - 1];
+        if (n2 == 0) return y[0];
+
+        //  Interpolation
+        const size_t n1 = n2 - 1;
+        auto t = (x0 - myX[n1]) / (myX[n2] - myX[n1]);
+
+        if constexpr (smoothStep)
+        {
+            return y[n1] + (y[n2] - y[n1]) * t * t * (3.0 - 2 * t);
+        }
+        else
+        {
+            return y[n1] + (y[n2] - y[n1]) * t;
+        }
+    }
+
+    //  Interpolates the values y on the knots in a block of points x0[n] into res[n]
+    //  Doubles only, and vectorized on uniform grids:
+    //      the index is clamped to the first and last intervals
+    //      and the weight to [0, 1], which extrapolates flat without branches
+    template <bool smoothStep=false>
+    void operator()(const double* y, const double* x0, double* res, const size_t n) const
+    {
+        if (myKind == Kind::uniform)
+        {
+            const double* x = &myX[0];
+            const double last = double(myN - 2);
+            for (size_t i = 0; i < n; ++i)
+            {
+                const double a = (x0[i] - myX0) * myInvH;
+                const size_t k = size_t(min(max(a, 0.0), last));
+                double t = (x0[i] - x[k]) / (x[k + 1] - x[k]);
+                t = min(max(t, 0.0), 1.0);
+                if constexpr (smoothStep) t = t * t * (3.0 - 2 * t);
+                res[i] = y[k] + (y[k + 1] - y[k]) * t;
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < n; ++i) res[i] = operator()<smoothStep>(y, x0[i]);
+        }
+    }
+};
+
+//  Piecewise polynomial interpolation
+//  =====================================
+
+//  Kinds of interpolation between knots:
+//      linear, smooth step (C1, zero slope on knots), or natural cubic spline (C2)
+enum class PolyKind { linear, smoothStep, cubic };
+
+//  Coefficients of a polynomial of degree up to 3 on a cell,
+//      aligned so that a cell never straddles cache lines
+template <class V>
+struct alignas(4 * sizeof(V)) polyCell
+{
+    V   c[4];
+};
+
+//  Evaluation of c[0] + c[1] u + ... + c[N-1] u^(N-1) with u = x - origin, Horner's scheme
+//  Overloaded for AAD numbers in AAD.h, to record a single node
+template <size_t N, class V, class X>
+inline V polyEval(const V* c, const double origin, const X& x)
+{
+    const auto u = x - origin;
+    V value = c[N - 1];
+    for (size_t k = N - 1; k-- > 0;) value = value * u + c[k];
+    return value;
+}
+
+//  Number of coefficients by kind
+constexpr size_t polyDegree(const PolyKind kind)
+{
+    return kind == PolyKind::linear ? 2 : 4;
+}
+
+//  Builds the n + 1 cells of the interpolation of y[n] on knots x[n]:
+//      cell 0 extrapolates flat on the left, cell k interpolates between knots k - 1 and k,
+//      and cell n extrapolates flat on the right,
+//  so the cell of x0 is the index of the first knot greater than x0, like upper_bound,
+//      and the origin of cell k is knot max(k, 1) - 1
+template <PolyKind kind, class V, class ITY>
+inline void polyCells(const vector<double>& x, ITY y, polyCell<V>* cells)
+{
+    const size_t n = x.size();
+
+    //  Flat extrapolation
+    for (size_t k : { size_t(0), n })
+    {
+        cells[k].c[0] = y[k ? n - 1 : 0];
+        cells[k].c[1] = cells[k].c[2] = cells[k].c[3] = 0.0;
+    }
+
+    //  Second derivatives of the natural cubic spline, tridiagonal system solved with Thomas's algorithm
+    vector<V> m;
+    if constexpr (kind == PolyKind::cubic)
+    {
+        m.resize(n, V(0.0));
+        if (n > 2)
+        {
+            vector<V> diag(n), rhs(n);
+            for (size_t k = 1; k + 1 < n; ++k)
+            {
+                const double h1 = x[k] - x[k - 1], h2 = x[k + 1] - x[k];
+                diag[k] = 2.0 * (h1 + h2);
+                rhs[k] = 6.0 * ((y[k + 1] - y[k]) / h2 - (y[k] - y[k - 1]) / h1);
+                //  Elimination
+                if (k > 1)
+                {
+                    const V w = h1 / diag[k - 1];
+                    diag[k] -= w * h1;
+                    rhs[k] -= w * rhs[k - 1];
+                }
+            }
+            //  Back substitution
+            for (size_t k = n - 2; k > 0; --k)
+            {
+                m[k] = (rhs[k] - (x[k + 1] - x[k]) * m[k + 1]) / diag[k];
+            }
+        }
+    }
+
+    //  Interpolation
+    for (size_t k = 1; k < n; ++k)
+    {
+        const double h = x[k] - x[k - 1];
+        const V y1 = y[k - 1], y2 = y[k];
+        V* c = cells[k].c;
+        c[0] = y1;
+        if constexpr (kind == PolyKind::linear)
+        {
+            c[1] = (y2 - y1) / h;
+            c[2] = c[3] = 0.0;
+        }
+        else if constexpr (kind == PolyKind::smoothStep)
+        {
+            c[1] = 0.0;
+            c[2] = 3.0 * (y2 - y1) / (h * h);
+            c[3] = -2.0 * (y2 - y1) / (h * h * h);
+        }
+        else
+        {
+            c[1] = (y2 - y1) / h - h * (2.0 * m[k - 1] + m[k]) / 6.0;
+            c[2] = 0.5 * m[k - 1];
+            c[3] = (m[k] - m[k - 1]) / (6.0 * h);
+        }
+    }
+}
+
+//  2D interpolation for a known sequence of y0s,
+//      typically the time steps of a simulation, where the vol surface is interpolated in (spot, time)
+//      with the same time for all paths on a given step
+//  The interpolation in y is performed once for all on construction, for every knot in x,
+//      and the resulting slices are represented as piecewise polynomials in x,
+//      with coefficients precomputed per cell
+//  Every call evaluates one polynomial in x0, 
+//      with a single node on tape with AAD, recording the partials to the touched coefficients and x0
+//  The knots in x are constants, sensitivities to their positions are not computed
+//  With kind = linear, the results are those of interp2D (up to rounding)
+template <class T, class V, PolyKind kind=PolyKind::linear>
+class interp2DSlices
+{
+    //  Values of knots in x, with fast bracketing on uniform grids
+    interpGrid<double>      myX;
+    //  Cells by y0s, x.size() + 1 per y0
+    size_t                  myCellsPerSlice;
+    vector<polyCell<V>>     myCells;
+
+    static vector<double> values(const vector<T>& x)
+    {
+        vector<double> res(x.size());
+        transform(x.begin(), x.end(), res.begin(), [](const T& xi) { return valueOf(xi); });
+        return res;
+    }
+
+    static constexpr size_t N = polyDegree(kind);
+
+public:
+
+    template <class U, class Y>
+    interp2DSlices(
+        //	sorted on xs 
+        const vector<T>&            x,
+        //	sorted on ys
+        const vector<U>&            y,
+        //  zs in a matrix, x in rows, y in columns
+        const matrix<V>&            z,
+        //  sequence of y0s
+        const vector<Y>&            y0s)
+        : myX(values(x)), myCellsPerSlice(x.size() + 1), myCells(y0s.size() * (x.size() + 1))
+    {
+        const size_t n = x.size();
+        const size_t m = y.size();
+
+        vector<V> slice(n);
+        for (size_t j = 0; j < y0s.size(); ++j)
+        {
+            //  Interpolate in y, smooth step with the smooth kinds, like interp2D<true>
+            for (size_t i = 0; i < n; ++i)
+            {
+                slice[i] = interp<kind != PolyKind::linear>(y.begin(), y.end(), z[i], z[i] + m, y0s[j]);
+            }
+
+            //  Coefficients in x
+            polyCells<kind>(myX.knots(), slice.begin(), &myCells[j * myCellsPerSlice]);
+        }
+    }
+
+    //  Interpolate in (x0, y0s[j])
+    template <class W>
+    V operator()(const size_t j, const W& x0) const
+    {
+        const size_t k = myX.upperBound(valueOf(x0));
+        return polyEval<N>(myCells[j * myCellsPerSlice + k].c, myX.knots()[max<size_t>(k, 1) - 1], x0);
+    }
+
+    //  Interpolate a block of points (x0[i], y0s[j]), doubles only
+    //  Vectorized on uniform grids: the cell is found with clamped arithmetic, without branches
+    void operator()(const size_t j, const double* x0, double* res, const size_t n) const
+    {
+        const polyCell<V>* cells = &myCells[j * myCellsPerSlice];
+        const double* x = myX.knots().data();
+
+        if (myX.kind() == interpGrid<double>::Kind::uniform)
+        {
+            const double last = double(myX.size());
+            for (size_t i = 0; i < n; ++i)
+            {
+                const size_t k = size_t(min(max(myX.arithmeticIdx(x0[i]) + 1.0, 0.0), last));
+                const size_t o = k - (k > 0);
+                res[i] = polyEval<N>(cells[k].c, x[o], x0[i]);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < n; ++i) res[i] = operator()(j, x0[i]);
+        }
+    }
+};
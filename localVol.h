@@ -0,0 +1,147 @@
+#pragma once
+
+//  Dupire's local volatility from implied volatility
+//  =================================================
+
+//  Builds the local volatility matrix consumed by dupireBarrierPricer out of a surface of market implied vols
+//  Templated on the number type, so AAD flows through the construction
+//      and risks can be reported against market implied vols
+
+//  Dupire's formula in terms of the total implied variance w(y, t) = iv^2 t, with y = log(K / S0),
+//      see Gatheral, The Volatility Surface, chapter 1
+//  Like the simulation code, we assume zero rates and dividends, so the forward is the spot:
+//  localVar(K, t) = dw/dt / (1 - y/w dw/dy + 1/4 (-1/4 - 1/w + y^2/w^2) (dw/dy)^2 + 1/2 d2w/dy2)
+
+//  The derivatives are computed on the market strikes by finite differences on the (non uniform) knots,
+//      then w and its strike derivatives are interpolated linearly in y, and w linearly in t,
+//      so dw/dt is constant between market maturities
+//  Implied vols are extrapolated flat in strike and time
+//  Local variance is floored, since arbitrage in the market surface may turn it negative
+
+#include "matrix.h"
+#include "interp.h"
+
+#include <math.h>
+#include <type_traits>
+#include <stdexcept>
+
+template <class T>
+inline void dupireLocalVols(
+    //  Spot
+    const T&                spot,
+    //  Market implied vols, strikes in rows, maturities in columns
+    const vector<double>&   strikes,
+    const vector<double>&   mats,
+    const matrix<T>&        impliedVols,
+    //  Local vol grid, spots in rows, times in columns, like in dupireBarrierPricer
+    const vector<double>&   spots,
+    const vector<double>&   times,
+    //  Results, resized to spots x times
+    matrix<T>&              vols,
+    //  Floor on local variance
+    const double            minVar = 1.0e-08)
+{
+    const size_t Nk = strikes.size(), Nm = mats.size();
+    if (!Nk || !Nm) throw runtime_error("dupireLocalVols: empty implied vol surface");
+
+    vols.resize(spots.size(), times.size());
+
+    //  With AAD, the tape is thread local, so the build runs on the calling thread
+    constexpr bool parallel = is_same<T, double>::value;
+
+    //  Log-strikes
+    vector<T> y(Nk);
+    for (size_t k = 0; k < Nk; ++k) y[k] = log(strikes[k] / spot);
+
+    //  Total variance and its first two derivatives in y, by maturity slice
+    matrix<T> w(Nm, Nk), wy(Nm, Nk), wyy(Nm, Nk);
+
+    #pragma omp parallel for if (parallel)
+    for (long long j = 0; j < (long long)Nm; ++j)
+    {
+        T* sw = w[j];
+        T* swy = wy[j];
+        T* swyy = wyy[j];
+
+        for (size_t k = 0; k < Nk; ++k) sw[k] = impliedVols[k][j] * impliedVols[k][j] * mats[j];
+
+        //  Three point differences on the non uniform knots
+        for (size_t k = 1; k + 1 < Nk; ++k)
+        {
+            const T h1 = y[k] - y[k - 1], h2 = y[k + 1] - y[k];
+            swy[k] = (h1 * h1 * sw[k + 1] - h2 * h2 * sw[k - 1] + (h2 * h2 - h1 * h1) * sw[k])
+                / (h1 * h2 * (h1 + h2));
+            swyy[k] = 2.0 * (h1 * sw[k + 1] - (h1 + h2) * sw[k] + h2 * sw[k - 1])
+                / (h1 * h2 * (h1 + h2));
+        }
+
+        //  Ends: same derivatives as the neighbour
+        if (Nk >= 3)
+        {
+            swy[0] = swy[1];
+            swyy[0] = swyy[1];
+            swy[Nk - 1] = swy[Nk - 2];
+            swyy[Nk - 1] = swyy[Nk - 2];
+        }
+        else
+        {
+            swy[0] = Nk == 2 ? (sw[1] - sw[0]) / (y[1] - y[0]) : T(0.0);
+            swy[Nk - 1] = swy[0];
+            swyy[0] = swyy[Nk - 1] = 0.0;
+        }
+    }
+
+    //  Local vols on the grid
+    #pragma omp parallel for if (parallel)
+    for (long long i = 0; i < (long long)spots.size(); ++i)
+    {
+        const T yi = log(spots[i] / spot);
+
+        //  Interpolate the slices in y, flat extrapolation
+        auto slice = [&](const matrix<T>& m, const size_t j)
+        {
+            return interp(y.begin(), y.end(), m[j], m[j] + Nk, yi);
+        };
+
+        for (size_t j = 0; j < times.size(); ++j)
+        {
+            //  At t = 0, Dupire's formula has a finite limit with flat implied vols in time
+            const double t = max(times[j], 1.0e-06);
+
+            T wt, wyt, wyyt, dwdt;
+
+            //  Bracketing maturities
+            const size_t n2 = distance(mats.begin(), upper_bound(mats.begin(), mats.end(), t));
+            if (n2 == 0 || n2 == Nm)
+            {
+                //  Extrapolation: flat implied vol, so total variance proportional to time
+                const size_t n = n2 ? Nm - 1 : 0;
+                const double scale = t / mats[n];
+                wt = slice(w, n) * scale;
+                wyt = slice(wy, n) * scale;
+                wyyt = slice(wyy, n) * scale;
+                dwdt = wt / t;
+            }
+            else
+            {
+                //  Interpolation: linear in total variance
+                const size_t n1 = n2 - 1;
+                const double dt = mats[n2] - mats[n1], l = (t - mats[n1]) / dt;
+                const T w1 = slice(w, n1), w2 = slice(w, n2);
+                wt = w1 + (w2 - w1) * l;
+                wyt = slice(wy, n1) * (1.0 - l) + slice(wy, n2) * l;
+                wyyt = slice(wyy, n1) * (1.0 - l) + slice(wyy, n2) * l;
+                dwdt = (w2 - w1) / dt;
+            }
+
+            //  Dupire
+            const T ratio = yi / wt;
+            const T den = 1.0 - ratio * wyt
+                + 0.25 * (-0.25 - 1.0 / wt + ratio * ratio) * wyt * wyt
+                + 0.5 * wyyt;
+            const T localVar = dwdt / den;
+
+            vols[i][j] = den > 0.0 && localVar > minVar ? sqrt(localVar) : T(sqrt(minVar));
+        }
+    }
+}
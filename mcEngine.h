@@ -0,0 +1,1600 @@
+#pragma once
+
+//  Generic Monte-Carlo engine
+//  ==========================
+
+//  Simulation drivers that run any model with any product,
+//      serial, parallel, randomized QMC and with AAD risks,
+//      so new products and models don't duplicate the drivers,
+//      and improvements to the drivers benefit all of them
+
+//  Models and products are class templates on the number type T (double or Number),
+//      with the following members, see DupireModel (dupireModel.h) and BarrierOption (dupireBarrier.h):
+
+//  Model<T>
+//      template <class U> Model(const Model<U>&)
+//          converting constructor, puts the parameters on tape with T = Number
+//      void init(const vector<double>& timeline)
+//          prepares the simulation of the spot on the (increasing, non-negative) event dates of the timeline,
+//          a date today is not a step: its spot is today's
+//      size_t simDim() const
+//          number of Gaussians per path, after init
+//      void generatePaths(const matrix<double>& gaussians, matrix<T>& paths, matrix<T>* variances, const size_t n) const
+//          simulates the n first paths of a block, step-major:
+//          gaussians[simDim][blockSize] -> paths[timeline][blockSize], the spot on the event dates
+//          and, unless variances is null, variances[timeline][blockSize],
+//          the variance of the log-spot integrated along the path from today to the event dates
+//          const and thread safe for doubles, since all threads share the model
+//      vector<T*> parameters()
+//          the parameters, in a fixed order, against which the AAD drivers report risks
+
+//  Product<T>
+//      template <class U> Product(const Product<U>&)
+//          converting constructor, puts the parameters on tape with T = Number
+//      const vector<double>& timeline() const
+//          the event dates
+//      bool needsVariances() const
+//          whether the payoffs read the integrated variances, which are otherwise not simulated
+//      void payoffs(const T* const* paths, const T* const* variances, const size_t n, T* payoffs) const
+//          payoffs of the n first paths of a block, paths[j][p] is the spot on path p on the j-th event date,
+//          variances[j][p] the integrated variance to that date, null when not needed
+
+//  Paths are simulated in blocks, step by step, so the loops over the paths of a block vectorize with doubles,
+//      see DupireModel::generatePaths
+
+//  The drivers price a vector of products in one pass: the paths are simulated once,
+//      on the merged timeline of the products, and every product is evaluated against them
+//  With AAD, the risks of all products are computed with one multi-adjoint sweep per batch,
+//      see calculateAdjoints(const vector<Number>&) in AAD.h
+//  The overloads for a single product forward to the vector versions
+//  The drivers with control variates, at the end of the file, add products with known means, see mcSimulCV
+//  The multilevel driver, last, prices a product refined over levels of discretization, see mcSimulMLMC
+
+#include "matrix.h"
+#include "random.h"
+#include "AAD.h"
+#include "threadPool.h"
+#include "reduction.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+
+
+//  Merged timeline: the sorted union of event dates, dates closer than 1e-12 are merged
+//  dateIdx[k][j] is the index in the merged timeline of the j-th date of timelines[k]
+inline void mcMergeTimelines(
+    const vector<const vector<double>*>&    timelines,
+    vector<double>&                         timeline,
+    vector<vector<size_t>>&                 dateIdx)
+{
+    constexpr double tol = 1.0e-12;
+
+    timeline.clear();
+    for (const auto dates : timelines) timeline.insert(timeline.end(), dates->begin(), dates->end());
+    if (timeline.empty()) throw runtime_error("mcTimeline: empty timeline");
+    sort(timeline.begin(), timeline.end());
+    timeline.erase(unique(timeline.begin(), timeline.end(),
+        [&](const double a, const double b) { return b - a < tol; }), timeline.end());
+
+    dateIdx.resize(timelines.size());
+    for (size_t k = 0; k < timelines.size(); ++k)
+    {
+        const vector<double>& dates = *timelines[k];
+        dateIdx[k].resize(dates.size());
+        for (size_t j = 0; j < dates.size(); ++j)
+        {
+            //  Last merged date no greater than the date, up to tolerance
+            dateIdx[k][j] = distance(timeline.begin(), upper_bound(timeline.begin(), timeline.end(), dates[j] + tol)) - 1;
+        }
+    }
+}
+
+//  Merged timeline of products, dateIdx[k][j] is the index of the j-th event date of product k
+template <class PRODUCT>
+inline void mcTimeline(
+    const vector<PRODUCT>&      products,
+    vector<double>&             timeline,
+    vector<vector<size_t>>&     dateIdx)
+{
+    vector<const vector<double>*> timelines;
+    for (const auto& product : products) timelines.push_back(&product.timeline());
+    mcMergeTimelines(timelines, timeline, dateIdx);
+}
+
+//  Copy of the model, initialized on a timeline
+template <class MODEL>
+inline MODEL mcInitModel(const MODEL& model, const vector<double>& timeline)
+{
+    MODEL cModel(model);
+    cModel.init(timeline);
+    return cModel;
+}
+
+//  End dates of the steps of positive length of a timeline, one Gaussian each
+inline vector<double> mcSteps(const vector<double>& timeline)
+{
+    vector<double> steps;
+    double t = 0.0;
+    for (const double date : timeline)
+    {
+        if (date > t) steps.push_back(date);
+        t = date;
+    }
+    return steps;
+}
+
+//  Initializes the RNG for a model initialized on the timeline
+//  When the model draws one Gaussian per step, the RNG gets the times of the steps,
+//      so path constructions like the Brownian bridge follow the actual, possibly uneven, steps
+template <class MODEL>
+inline void mcInitRNG(RNG& random, const MODEL& model, const vector<double>& timeline)
+{
+    const vector<double> steps = mcSteps(timeline);
+    if (model.simDim() == steps.size()) random.initSteps(steps);
+    else random.init(model.simDim());
+}
+
+//  Average payoffs of products over a batch of paths
+template <class T, class MODEL, class PRODUCT>
+inline void mcBatch(
+    //  Model, initialized on the merged timeline
+    const MODEL&                    model,
+    //  Products, the merged timeline and the indices of their event dates, see mcTimeline
+    const vector<PRODUCT>&          products,
+    const vector<double>&           timeline,
+    const vector<vector<size_t>>&   dateIdx,
+    //  First and last path
+    const long long                 firstPath,
+    const long long                 lastPath,
+    //  Random number generator
+    RNG&                            random,
+    //  Results, by product
+    T*                              results)
+{
+    //  Paths in a block
+    constexpr size_t blockSize = 256;
+
+    //  Working memory: Gaussians by simulation dimension, paths by event date
+    const size_t dim = model.simDim(), numDates = timeline.size(), numProducts = products.size();
+    vector<double> gaussianMemory(dim);
+    matrix<double> gaussians(dim, blockSize);
+    matrix<T> paths(numDates, blockSize);
+    vector<T> payoffs(blockSize);
+
+    //  Integrated variances, only simulated when needed
+    bool needsVariances = false;
+    for (const auto& product : products) needsVariances = needsVariances || product.needsVariances();
+    matrix<T> variances;
+    if (needsVariances) variances.resize(numDates, blockSize);
+
+    //  Paths on the event dates of every product
+    vector<vector<const T*>> productPaths(numProducts), productVariances(numProducts);
+    for (size_t k = 0; k < numProducts; ++k)
+    {
+        for (const size_t j : dateIdx[k])
+        {
+            productPaths[k].push_back(paths[j]);
+            productVariances[k].push_back(needsVariances ? variances[j] : nullptr);
+        }
+    }
+
+	//	Set RNG state to the first path in the batch
+	random.skipTo(firstPath);
+
+    //  Loop over blocks
+    fill(results, results + numProducts, T(0.0));
+    for (long long first = firstPath; first < lastPath; first += blockSize)
+    {
+        const size_t m = size_t(min<long long>(blockSize, lastPath - first));
+
+        //  Gaussian numbers, transposed into steps x paths
+        //  (read without copy if the RNG holds them in memory)
+        for (size_t p = 0; p < m; ++p)
+        {
+            const double* gaussianIncrements = random.nextGPtr(gaussianMemory);
+            for (size_t j = 0; j < dim; ++j) gaussians[j][p] = gaussianIncrements[j];
+        }
+
+        //  Simulate once
+        model.generatePaths(gaussians, paths, needsVariances ? &variances : nullptr, m);
+
+        //  Pay every product
+        for (size_t k = 0; k < numProducts; ++k)
+        {
+            products[k].payoffs(productPaths[k].data(), productVariances[k].data(), m, payoffs.data());
+            for (size_t p = 0; p < m; ++p) results[k] += payoffs[p];
+        }
+    }
+
+    for (size_t k = 0; k < numProducts; ++k) results[k] /= double(lastPath - firstPath);
+}
+
+//  Serial pricer
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline vector<double> mcSimul(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    //  Number of paths
+    const long long			        Np,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random)
+{
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcTimeline(products, timeline, dateIdx);
+    const MODEL<double> cModel = mcInitModel(model, timeline);
+	mcInitRNG(random, cModel, timeline);
+
+    const size_t numProducts = products.size();
+    vector<double> results(numProducts, 0.0), batchPrices(numProducts);
+	long long firstPath = 0;
+	while (firstPath < Np)
+	{
+		const long long lastPath = min<long long>(firstPath + Nb, Np);
+		mcBatch<double>(cModel, products, timeline, dateIdx, firstPath, lastPath, random, batchPrices.data());
+		for (size_t k = 0; k < numProducts; ++k) results[k] += batchPrices[k] * (lastPath - firstPath) / Np;
+		firstPath = lastPath;
+	}
+
+	return results;
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline double mcSimul(
+    const MODEL<double>&    model,
+    const PRODUCT<double>&  product,
+    const long long			Np,
+	const int				Nb,
+    RNG&					random)
+{
+    return mcSimul(model, vector<PRODUCT<double>>(1, product), Np, Nb, random)[0];
+}
+
+//  Parallel pricer, batches on the thread pool, results independent of the number of threads
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline vector<double> mcSimulMT(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    //  Number of paths
+    const long long			        Np,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random)
+{
+    //  The model is shared by all threads
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcTimeline(products, timeline, dateIdx);
+    const MODEL<double> cModel = mcInitModel(model, timeline);
+	mcInitRNG(random, cModel, timeline);
+
+	//  Memory for the storage of batch-wise results, batches in rows, products in columns
+    const size_t numProducts = products.size();
+    const long long numBatches = (Np - 1) / Nb + 1;
+    matrix<double> batchResults(numBatches, numProducts);
+
+    //  Copies of the (mutable) RNG, one per thread, made on first use
+    ThreadPool& pool = ThreadPool::instance();
+    vector<unique_ptr<RNG>> rngs(pool.numThreads());
+
+	//	Iterate over batches, in parallel, with dynamic scheduling
+	pool.parallelFor(numBatches, [&](const size_t batch, const size_t thread)
+	{
+		const long long firstPath = (long long)batch * Nb;
+		const long long lastPath = min<long long>(firstPath + Nb, Np);
+
+        //  The copy of the RNG of this thread
+        auto& cRandom = rngs[thread];
+        if (!cRandom) cRandom = random.clone();
+
+        //  Process the batch
+        double* results = batchResults[batch];
+        mcBatch<double>(cModel, products, timeline, dateIdx, firstPath, lastPath, *cRandom, results);
+        for (size_t k = 0; k < numProducts; ++k) results[k] *= lastPath - firstPath;
+	});
+
+    //  Average results over batches, pairwise, so results don't depend on the number of threads
+    PairwiseSum sum(numProducts);
+    for (long long batch = 0; batch < numBatches; ++batch) sum.add(batchResults[batch]);
+    vector<double> results(numProducts);
+    sum.result(results.data());
+    for (auto& result : results) result /= Np;
+
+    return results;
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline double mcSimulMT(
+    const MODEL<double>&    model,
+    const PRODUCT<double>&  product,
+    const long long			Np,
+	const int				Nb,
+    RNG&					random)
+{
+    return mcSimulMT(model, vector<PRODUCT<double>>(1, product), Np, Nb, random)[0];
+}
+
+//  Randomized QMC: prices with R independent randomizations of the RNG,
+//      for instance scrambled Sobol with different seeds,
+//      all replications and batches in parallel
+//  Returns the means of replications and their standard errors, by product
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcSimulRQMC(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    //  Number of paths in every replication
+    const long long			        Np,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Independent randomized RNGs, one per replication
+    const vector<unique_ptr<RNG>>&  randoms,
+	//	Results
+	vector<double>&			        prices,
+	vector<double>&			        stdErrs)
+{
+    const int R = int(randoms.size());
+
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcTimeline(products, timeline, dateIdx);
+    const MODEL<double> cModel = mcInitModel(model, timeline);
+
+	//  Memory for the storage of batch-wise results, replications and batches in rows, products in columns
+    const size_t numProducts = products.size();
+    const long long numBatches = (Np - 1) / Nb + 1;
+    matrix<double> batchResults(R * numBatches, numProducts);
+
+	//	Initialize the RNGs
+    for (auto& random : randoms) mcInitRNG(*random, cModel, timeline);
+
+    //  Copies of the (mutable) RNGs, by thread and replication, made on first use
+    ThreadPool& pool = ThreadPool::instance();
+    matrix<unique_ptr<RNG>> rngs(pool.numThreads(), R);
+
+	//	Iterate over replications and batches, in parallel, with dynamic scheduling
+	pool.parallelFor(R * numBatches, [&](const size_t task, const size_t thread)
+	{
+        const int rep = int((long long)task / numBatches);
+        const long long batch = (long long)task % numBatches;
+		const long long firstPath = batch * Nb;
+		const long long lastPath = min<long long>(firstPath + Nb, Np);
+
+        //  The copy of the RNG of the replication for this thread
+        auto& cRandom = rngs[thread][rep];
+        if (!cRandom) cRandom = randoms[rep]->clone();
+
+        //  Process the batch
+        double* results = batchResults[task];
+        mcBatch<double>(cModel, products, timeline, dateIdx, firstPath, lastPath, *cRandom, results);
+        for (size_t k = 0; k < numProducts; ++k) results[k] *= lastPath - firstPath;
+	});
+
+    //  Prices of every replication, pairwise over batches
+    matrix<double> repPrices(R, numProducts);
+    for (int rep = 0; rep < R; ++rep)
+    {
+        PairwiseSum sum(numProducts);
+        for (long long batch = 0; batch < numBatches; ++batch) sum.add(batchResults[rep * numBatches + batch]);
+        sum.result(repPrices[rep]);
+        for (size_t k = 0; k < numProducts; ++k) repPrices[rep][k] /= Np;
+    }
+
+    //  Means and standard errors over replications
+    prices.resize(numProducts);
+    stdErrs.resize(numProducts);
+    for (size_t k = 0; k < numProducts; ++k)
+    {
+        PairwiseSum sum;
+        for (int rep = 0; rep < R; ++rep) sum.add(repPrices[rep][k]);
+        const double price = sum.result() / R;
+        double var = 0.0;
+        for (int rep = 0; rep < R; ++rep) var += (repPrices[rep][k] - price) * (repPrices[rep][k] - price);
+        prices[k] = price;
+        stdErrs[k] = R > 1 ? sqrt(var / (R - 1) / R) : 0.0;
+    }
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcSimulRQMC(
+    const MODEL<double>&            model,
+    const PRODUCT<double>&          product,
+    const long long			        Np,
+	const int				        Nb,
+    const vector<unique_ptr<RNG>>&  randoms,
+	double&					        price,
+	double&					        stdErr)
+{
+    vector<double> prices, stdErrs;
+    mcSimulRQMC(model, vector<PRODUCT<double>>(1, product), Np, Nb, randoms, prices, stdErrs);
+    price = prices[0];
+    stdErr = stdErrs[0];
+}
+
+//  Adaptive pricer: runs batches in parallel, in rounds, until the standard errors of all products
+//      fall below a tolerance, or a maximum number of paths or a time budget is reached
+//  Standard errors are estimated from the dispersion of the (independent, equally sized) batch averages,
+//      so they remain valid with antithetic sampling or moment matching within batches,
+//      and the first check is made after minBatches batches
+//  Every round is sized to reach the tolerance given the current estimate, at most doubling the number of batches
+//  Rounds and stopping decisions only depend on the batch results, accumulated in batch order,
+//      so results are reproducible given the RNG, whatever the number of threads
+//  When the time budget is hit, the remaining batches of the round are skipped,
+//      and the results are those of the batches completed in sequence,
+//      still the same as with a maximum number of paths set to the number of paths used
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcSimulAdaptive(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random,
+    //  Target standard error
+    const double                    tolerance,
+    //  Maximum number of paths, rounded up to whole batches
+    const long long                 maxPaths,
+    //  Time budget in seconds, 0 for none, the first round always completes
+    const double                    maxSeconds,
+	//	Results
+	vector<double>&			        prices,
+	vector<double>&			        stdErrs,
+    long long&                      paths)
+{
+    constexpr long long minBatches = 16;
+
+    const auto start = chrono::steady_clock::now();
+    auto timeOut = [&]()
+    {
+        return maxSeconds > 0.0 && chrono::duration<double>(chrono::steady_clock::now() - start).count() > maxSeconds;
+    };
+
+    //  The model is shared by all threads
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcTimeline(products, timeline, dateIdx);
+    const MODEL<double> cModel = mcInitModel(model, timeline);
+	mcInitRNG(random, cModel, timeline);
+
+    const size_t numProducts = products.size();
+    const long long maxBatches = max<long long>(1, (maxPaths - 1) / Nb + 1);
+
+    //  Copies of the (mutable) RNG, one per thread, made on first use
+    ThreadPool& pool = ThreadPool::instance();
+    vector<unique_ptr<RNG>> rngs(pool.numThreads());
+
+    //  Running mean and sum of squared deviations of batch averages, by product, see Welford
+    vector<double> mean(numProducts, 0.0), m2(numProducts, 0.0);
+    long long numBatches = 0;
+
+    //  Results of the batches of a round, and whether they completed in the time budget
+    matrix<double> batchResults;
+    vector<char> completed;
+
+    long long nextBatches = min(minBatches, maxBatches);
+    for (;;)
+    {
+        const long long roundSize = nextBatches - numBatches;
+        batchResults.resize(roundSize, numProducts);
+        completed.assign(roundSize, 0);
+
+	    //	Iterate over the batches of the round, in parallel, with dynamic scheduling
+	    pool.parallelFor(roundSize, [&](const size_t task, const size_t thread)
+	    {
+            if (numBatches > 0 && timeOut()) return;
+
+            const long long firstPath = (numBatches + (long long)task) * Nb;
+
+            //  The copy of the RNG of this thread
+            auto& cRandom = rngs[thread];
+            if (!cRandom) cRandom = random.clone();
+
+            mcBatch<double>(cModel, products, timeline, dateIdx, firstPath, firstPath + Nb, *cRandom, batchResults[task]);
+            completed[task] = 1;
+	    });
+
+        //  Accumulate the batches completed in sequence
+        long long task = 0;
+        for (; task < roundSize && completed[task]; ++task)
+        {
+            ++numBatches;
+            const double* results = batchResults[task];
+            for (size_t k = 0; k < numProducts; ++k)
+            {
+                const double delta = results[k] - mean[k];
+                mean[k] += delta / numBatches;
+                m2[k] += delta * (results[k] - mean[k]);
+            }
+        }
+        const bool outOfTime = task < roundSize || timeOut();
+
+        //  Largest standard error
+        double maxErr = 0.0;
+        for (size_t k = 0; k < numProducts; ++k)
+        {
+            maxErr = max(maxErr, numBatches > 1 ? sqrt(m2[k] / (numBatches - 1) / numBatches) : 0.0);
+        }
+
+        if (maxErr <= tolerance || numBatches >= maxBatches || outOfTime) break;
+
+        //  Standard errors decrease in the square root of the number of batches
+        const double needed = numBatches * (maxErr / tolerance) * (maxErr / tolerance);
+        nextBatches = (long long)min(max(needed, double(numBatches + minBatches)), 2.0 * numBatches);
+        nextBatches = min(nextBatches, maxBatches);
+    }
+
+    prices = mean;
+    stdErrs.resize(numProducts);
+    for (size_t k = 0; k < numProducts; ++k)
+    {
+        stdErrs[k] = numBatches > 1 ? sqrt(m2[k] / (numBatches - 1) / numBatches) : 0.0;
+    }
+    paths = numBatches * Nb;
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcSimulAdaptive(
+    const MODEL<double>&    model,
+    const PRODUCT<double>&  product,
+	const int				Nb,
+    RNG&					random,
+    const double            tolerance,
+    const long long         maxPaths,
+    const double            maxSeconds,
+	double&			        price,
+	double&			        stdErr,
+    long long&              paths)
+{
+    vector<double> prices, stdErrs;
+    mcSimulAdaptive(model, vector<PRODUCT<double>>(1, product), Nb, random, tolerance, maxPaths, maxSeconds,
+        prices, stdErrs, paths);
+    price = prices[0];
+    stdErr = stdErrs[0];
+}
+
+//  AAD over one batch, on the tape of the calling thread
+//  Writes the prices of the products, then their risks against the model parameters, products major,
+//      all times the number of paths, in results, an array of numProducts x (1 + numParams)
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcBatchRisks(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    //  Merged timeline and event dates of the products, see mcTimeline
+    const vector<double>&           timeline,
+    const vector<vector<size_t>>&   dateIdx,
+    //  First and last path
+    const long long                 firstPath,
+    const long long                 lastPath,
+    //  Random number generator
+    RNG&                            random,
+    //  Results
+    double*                         results)
+{
+	//	Wipe the tape
+	tape.clear();
+
+	//	Put parameters on tape, by conversion into Number types
+    MODEL<Number> nModel(model);
+    const vector<PRODUCT<Number>> nProducts(products.begin(), products.end());
+    nModel.init(timeline);
+
+	//	Compute the batch
+    const size_t numProducts = products.size();
+    vector<Number> nBatchPrices(numProducts);
+	mcBatch<Number>(nModel, nProducts, timeline, dateIdx, firstPath, lastPath, random, nBatchPrices.data());
+
+	//	Pick results
+    const double paths = lastPath - firstPath;
+    const vector<Number*> params = nModel.parameters();
+    const size_t numParams = params.size();
+    for (size_t k = 0; k < numProducts; ++k) results[k] = nBatchPrices[k].value * paths;
+    double* risks = results + numProducts;
+
+	//	Back-propagate derivatives, in one sweep for all products
+    if (numProducts == 1)
+    {
+	    vector<double> adjoints = calculateAdjoints(nBatchPrices[0]);
+        for (size_t i = 0; i < numParams; ++i) risks[i] = adjoints[params[i]->idx] * paths;
+    }
+    else
+    {
+        matrix<double> adjoints = calculateAdjoints(nBatchPrices);
+        for (size_t k = 0; k < numProducts; ++k) for (size_t i = 0; i < numParams; ++i)
+        {
+            risks[k * numParams + i] = adjoints[params[i]->idx][k] * paths;
+        }
+    }
+}
+
+//  Serial prices and risks against the model parameters, products in rows, parameters in the order of model.parameters()
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcRisks(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    //  Number of paths
+    const long long			        Np,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random,
+	//	Results
+	vector<double>&			        prices,
+	matrix<double>&			        risks)
+{
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcTimeline(products, timeline, dateIdx);
+    MODEL<double> cModel = mcInitModel(model, timeline);
+    const size_t numProducts = products.size(), numParams = cModel.parameters().size();
+
+	//	Allocate and initialize results
+    //  prices and risks, see mcBatchRisks
+    vector<double> results(numProducts * (1 + numParams), 0.0), batchResults(results.size());
+
+	//	Initialize the RNG
+	mcInitRNG(random, cModel, timeline);
+
+	//	Loop over batches
+	long long firstPath = 0;
+	while (firstPath < Np)
+	{
+		const long long lastPath = min<long long>(firstPath + Nb, Np);
+
+		//	Accumulate
+		mcBatchRisks(model, products, timeline, dateIdx, firstPath, lastPath, random, batchResults.data());
+		transform(results.begin(), results.end(), batchResults.begin(), results.begin(),
+			[&](const double& result, const double& batchResult) { return result + batchResult / Np; });
+
+		//	Next batch
+		firstPath = lastPath;
+	}
+
+    prices.assign(results.begin(), results.begin() + numProducts);
+    risks.resize(numProducts, numParams);
+    copy(results.begin() + numProducts, results.end(), risks.begin());
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcRisks(
+    const MODEL<double>&    model,
+    const PRODUCT<double>&  product,
+    const long long			Np,
+	const int				Nb,
+    RNG&					random,
+	double&					price,
+	vector<double>&			risks)
+{
+    vector<double> prices;
+    matrix<double> productRisks;
+    mcRisks(model, vector<PRODUCT<double>>(1, product), Np, Nb, random, prices, productRisks);
+    price = prices[0];
+    risks.assign(productRisks.begin(), productRisks.end());
+}
+
+//  Parallel prices and risks against the model parameters, products in rows, parameters in the order of model.parameters()
+//  Results are independent of the number of threads
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcRisksMT(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    //  Number of paths
+    const long long			        Np,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random,
+	//	Results
+	vector<double>&			        prices,
+	matrix<double>&			        risks)
+{
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcTimeline(products, timeline, dateIdx);
+    MODEL<double> cModel = mcInitModel(model, timeline);
+    const size_t numProducts = products.size(), numParams = cModel.parameters().size();
+    //  prices and risks, see mcBatchRisks
+    const size_t numResults = numProducts * (1 + numParams);
+
+    const long long numBatches = (Np - 1) / Nb + 1;
+
+	//	Initialize the RNG
+	mcInitRNG(random, cModel, timeline);
+
+    //  Copies of the (mutable) RNG, one per thread, made on first use
+    ThreadPool& pool = ThreadPool::instance();
+    vector<unique_ptr<RNG>> rngs(pool.numThreads());
+
+    //  The batches are processed in contiguous chunks, a few per thread for load balance,
+    //      every chunk accumulates the results of its batches in its own buffer, pairwise,
+    //  so memory is O(threads x log(batches) x results) irrespective of the number of batches
+    //  The chunk size is a power of 2, so the chunks sum complete subtrees of the batch tree
+    //      and results are bit-identical whatever the number of threads, see reduction.h
+    long long chunkSize = 1;
+    while (numBatches > chunkSize * (long long)(4 * pool.numThreads())) chunkSize *= 2;
+    const long long numChunks = (numBatches - 1) / chunkSize + 1;
+    vector<PairwiseSum> chunkResults(numChunks, PairwiseSum(numResults));
+
+	//	Iterate over chunks, in parallel, with dynamic scheduling
+	pool.parallelFor(numChunks, [&](const size_t chunk, const size_t thread)
+	{
+        //  The copy of the RNG of this thread
+        auto& cRandom = rngs[thread];
+        if (!cRandom) cRandom = random.clone();
+
+        //  Accumulator of the chunk
+        PairwiseSum& chunkResult = chunkResults[chunk];
+        static thread_local vector<double> batchResults;
+        batchResults.resize(numResults);
+
+        //  Batches of the chunk
+        const long long firstBatch = (long long)chunk * chunkSize;
+        const long long lastBatch = min(firstBatch + chunkSize, numBatches);
+        for (long long batch = firstBatch; batch < lastBatch; ++batch)
+        {
+		    const long long firstPath = batch * Nb;
+		    const long long lastPath = min<long long>(firstPath + Nb, Np);
+
+            mcBatchRisks(model, products, timeline, dateIdx, firstPath, lastPath, *cRandom, batchResults.data());
+            chunkResult.add(batchResults.data());
+        }
+	});
+
+	//	Append the subtrees of the chunks, in order
+    PairwiseSum sum(numResults);
+    for (const auto& chunkResult : chunkResults) sum.add(chunkResult);
+    vector<double> results(numResults);
+    sum.result(results.data());
+    for (auto& result : results) result /= Np;
+
+    prices.assign(results.begin(), results.begin() + numProducts);
+    risks.resize(numProducts, numParams);
+    copy(results.begin() + numProducts, results.end(), risks.begin());
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcRisksMT(
+    const MODEL<double>&    model,
+    const PRODUCT<double>&  product,
+    const long long			Np,
+	const int				Nb,
+    RNG&					random,
+	double&					price,
+	vector<double>&			risks)
+{
+    vector<double> prices;
+    matrix<double> productRisks;
+    mcRisksMT(model, vector<PRODUCT<double>>(1, product), Np, Nb, random, prices, productRisks);
+    price = prices[0];
+    risks.assign(productRisks.begin(), productRisks.end());
+}
+
+//  Control variates
+//  ================
+
+//  Controls are products with a known mean, priced on the paths of a control model,
+//      simulated with the same Gaussians as the model, so their payoffs are correlated with the products'
+//      it reads the first Gaussians of the model, so its simDim() must not exceed the model's
+//  The model provides the control model, and the controls their means in it:
+//      Model<T>::controlModel() const, after init, for instance BlackScholesModel<T>, see DupireModel
+//      Control<T>::expectation(const ControlModel<T>&) const, the closed form, for instance EuropeanCall<T>
+//  Every product is priced as mean(Y) - beta' (mean(X) - E[X]), Y the payoff of the product, X those of the controls,
+//      with the coefficients beta = Cov(X, X)^-1 Cov(X, Y) that minimize the variance, estimated on the same run
+//  With AAD, the risks are those of the controlled estimate with beta held constant,
+//      which is how the risks of the controls and of their closed forms, sharing the parameters of the model, cancel
+//  Standard errors are estimated from the dispersion of the controlled batch averages, see mcSimulAdaptive and mcCVStdErrs
+
+//  Batch with controls: the payoffs of the products on the paths of the model,
+//      then those of the controls on the paths of the control model,
+//      the M = products + controls averages in results,
+//      and the sums of cross products of the payoffs, M x M, accumulated in moments, for the regression
+template <class T, class MODEL, class CVMODEL, class PRODUCT, class CONTROL>
+inline void mcBatchCV(
+    //  Models, initialized on the merged timeline
+    const MODEL&                    model,
+    const CVMODEL&                  cvModel,
+    //  Products and controls, the merged timeline and the indices of their event dates, see mcMergeTimelines
+    const vector<PRODUCT>&          products,
+    const vector<CONTROL>&          controls,
+    const vector<double>&           timeline,
+    const vector<vector<size_t>>&   dateIdx,
+    //  First and last path
+    const long long                 firstPath,
+    const long long                 lastPath,
+    //  Random number generator
+    RNG&                            random,
+    //  Results
+    T*                              results,
+    double*                         moments)
+{
+    //  Paths in a block
+    constexpr size_t blockSize = 256;
+
+    //  Working memory: Gaussians by simulation dimension, paths by event date
+    const size_t dim = model.simDim(), numDates = timeline.size(), K = products.size(), M = K + controls.size();
+    vector<double> gaussianMemory(dim);
+    matrix<double> gaussians(dim, blockSize);
+    matrix<T> paths(numDates, blockSize), cvPaths(numDates, blockSize);
+    matrix<T> payoffs(M, blockSize);
+    matrix<double> values(M, blockSize);
+
+    //  Integrated variances, only simulated when needed
+    bool needsVariances = false, cvNeedsVariances = false;
+    for (const auto& product : products) needsVariances = needsVariances || product.needsVariances();
+    for (const auto& control : controls) cvNeedsVariances = cvNeedsVariances || control.needsVariances();
+    matrix<T> variances, cvVariances;
+    if (needsVariances) variances.resize(numDates, blockSize);
+    if (cvNeedsVariances) cvVariances.resize(numDates, blockSize);
+
+    //  Paths on the event dates of every product and control
+    vector<vector<const T*>> productPaths(M), productVariances(M);
+    for (size_t k = 0; k < M; ++k)
+    {
+        for (const size_t j : dateIdx[k])
+        {
+            productPaths[k].push_back(k < K ? paths[j] : cvPaths[j]);
+            productVariances[k].push_back(
+                k < K ? (needsVariances ? variances[j] : nullptr) : (cvNeedsVariances ? cvVariances[j] : nullptr));
+        }
+    }
+
+	//	Set RNG state to the first path in the batch
+	random.skipTo(firstPath);
+
+    //  Loop over blocks
+    fill(results, results + M, T(0.0));
+    fill(moments, moments + M * M, 0.0);
+    for (long long first = firstPath; first < lastPath; first += blockSize)
+    {
+        const size_t m = size_t(min<long long>(blockSize, lastPath - first));
+
+        //  Gaussian numbers, transposed into steps x paths
+        for (size_t p = 0; p < m; ++p)
+        {
+            const double* gaussianIncrements = random.nextGPtr(gaussianMemory);
+            for (size_t j = 0; j < dim; ++j) gaussians[j][p] = gaussianIncrements[j];
+        }
+
+        //  Simulate both models with the same Gaussians
+        model.generatePaths(gaussians, paths, needsVariances ? &variances : nullptr, m);
+        cvModel.generatePaths(gaussians, cvPaths, cvNeedsVariances ? &cvVariances : nullptr, m);
+
+        //  Pay
+        for (size_t k = 0; k < M; ++k)
+        {
+            if (k < K) products[k].payoffs(productPaths[k].data(), productVariances[k].data(), m, payoffs[k]);
+            else controls[k - K].payoffs(productPaths[k].data(), productVariances[k].data(), m, payoffs[k]);
+            for (size_t p = 0; p < m; ++p)
+            {
+                results[k] += payoffs[k][p];
+                values[k][p] = valueOf(payoffs[k][p]);
+            }
+        }
+
+        //  Cross products, upper triangle
+        for (size_t a = 0; a < M; ++a) for (size_t b = a; b < M; ++b)
+        {
+            double sum = 0.0;
+            for (size_t p = 0; p < m; ++p) sum += values[a][p] * values[b][p];
+            moments[a * M + b] += sum;
+        }
+    }
+
+    for (size_t k = 0; k < M; ++k) results[k] /= double(lastPath - firstPath);
+    for (size_t a = 0; a < M; ++a) for (size_t b = 0; b < a; ++b) moments[a * M + b] = moments[b * M + a];
+}
+
+//  Regression of the products on the controls, over N paths,
+//      given the sums of the payoffs (products then controls) and of their cross products, see mcBatchCV
+//  Writes the coefficients beta, products x controls
+//  Controls that are (numerically) linear combinations of others are dropped, with zero coefficients
+inline void mcRegression(
+    const size_t        K,
+    const size_t        C,
+    const double        N,
+    const double*       sums,
+    const double*       moments,
+    matrix<double>&     beta)
+{
+    const size_t M = K + C;
+    auto cov = [&](const size_t a, const size_t b)
+    {
+        return (moments[a * M + b] - sums[a] * sums[b] / N) / (N - 1.0);
+    };
+
+    //  Cov(X, X) and Cov(X, Y)
+    matrix<double> cxx(C, C), cxy(C, K);
+    for (size_t c = 0; c < C; ++c)
+    {
+        for (size_t d = 0; d < C; ++d) cxx[c][d] = cov(K + c, K + d);
+        for (size_t k = 0; k < K; ++k) cxy[c][k] = cov(K + c, k);
+    }
+
+    //  Solve Cov(X, X) beta' = Cov(X, Y) by Gauss-Jordan elimination,
+    //      controls with vanishing pivots are dropped
+    matrix<double> a(cxx), x(cxy);
+    vector<bool> dropped(C, false);
+    double scale = 0.0;
+    for (size_t c = 0; c < C; ++c) scale = max(scale, cxx[c][c]);
+    for (size_t c = 0; c < C; ++c)
+    {
+        //  Partial pivoting
+        size_t piv = c;
+        for (size_t r = c + 1; r < C; ++r) if (fabs(a[r][c]) > fabs(a[piv][c])) piv = r;
+        if (fabs(a[piv][c]) <= 1.0e-12 * scale)
+        {
+            dropped[c] = true;
+            continue;
+        }
+        if (piv != c)
+        {
+            for (size_t j = 0; j < C; ++j) swap(a[c][j], a[piv][j]);
+            for (size_t k = 0; k < K; ++k) swap(x[c][k], x[piv][k]);
+        }
+
+        const double inv = 1.0 / a[c][c];
+        for (size_t r = 0; r < C; ++r) if (r != c && a[r][c] != 0.0)
+        {
+            const double f = a[r][c] * inv;
+            for (size_t j = c; j < C; ++j) a[r][j] -= f * a[c][j];
+            for (size_t k = 0; k < K; ++k) x[r][k] -= f * x[c][k];
+        }
+    }
+
+    beta.resize(K, C);
+    for (size_t k = 0; k < K; ++k) for (size_t c = 0; c < C; ++c)
+    {
+        beta[k][c] = dropped[c] ? 0.0 : x[c][k] / a[c][c];
+    }
+}
+
+//  Standard errors of the controlled estimates, from the dispersion of the controlled batch averages
+//      mean(Y) - beta' (mean(X) - E[X]) over the batches, weighted by their number of paths,
+//      given the sums of the payoffs by batch, products then controls, in the first M columns of batchSums
+//  Batches are independent, unlike paths, so the errors remain valid with antithetic sampling or moment matching
+inline void mcCVStdErrs(
+    const size_t            K,
+    const size_t            C,
+    const long long         Np,
+    const int               Nb,
+    const matrix<double>&   batchSums,
+    const matrix<double>&   beta,
+    const vector<double>&   means,
+    vector<double>&         stdErrs)
+{
+    const long long numBatches = (Np - 1) / Nb + 1;
+
+    stdErrs.resize(K);
+    for (size_t k = 0; k < K; ++k)
+    {
+        //  Controlled sum of a batch
+        auto controlled = [&](const long long batch, const double paths)
+        {
+            const double* sums = batchSums[batch];
+            double z = sums[k];
+            for (size_t c = 0; c < C; ++c) z -= beta[k][c] * (sums[K + c] - paths * means[c]);
+            return z;
+        };
+
+        double mean = 0.0;
+        for (long long batch = 0; batch < numBatches; ++batch)
+        {
+            mean += controlled(batch, double(min<long long>(Nb, Np - batch * Nb)));
+        }
+        mean /= Np;
+
+        double var = 0.0;
+        for (long long batch = 0; batch < numBatches; ++batch)
+        {
+            const double paths = double(min<long long>(Nb, Np - batch * Nb));
+            const double dev = controlled(batch, paths) / paths - mean;
+            var += paths * dev * dev;
+        }
+        stdErrs[k] = numBatches > 1 ? sqrt(var / (numBatches - 1) / Np) : 0.0;
+    }
+}
+
+//  Parallel pricer with control variates
+//  Returns the controlled prices and their standard errors, by product, and the coefficients
+template <template <class> class MODEL, template <class> class PRODUCT, template <class> class CONTROL>
+inline void mcSimulCV(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    const vector<CONTROL<double>>&  controls,
+    //  Number of paths
+    const long long			        Np,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random,
+	//	Results
+	vector<double>&			        prices,
+	vector<double>&			        stdErrs,
+    matrix<double>&                 beta)
+{
+    //  Merged timeline of products and controls
+    vector<const vector<double>*> timelines;
+    for (const auto& product : products) timelines.push_back(&product.timeline());
+    for (const auto& control : controls) timelines.push_back(&control.timeline());
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcMergeTimelines(timelines, timeline, dateIdx);
+
+    //  The models are shared by all threads
+    const MODEL<double> cModel = mcInitModel(model, timeline);
+    const auto cvModel = mcInitModel(cModel.controlModel(), timeline);
+    if (cvModel.simDim() > cModel.simDim())
+    {
+        throw runtime_error("mcSimulCV: the control model draws more Gaussians than the model");
+    }
+	mcInitRNG(random, cModel, timeline);
+
+	//  Memory for the storage of batch-wise sums and cross products
+    const size_t K = products.size(), C = controls.size(), M = K + C;
+    const long long numBatches = (Np - 1) / Nb + 1;
+    matrix<double> batchResults(numBatches, M + M * M);
+
+    //  Copies of the (mutable) RNG, one per thread, made on first use
+    ThreadPool& pool = ThreadPool::instance();
+    vector<unique_ptr<RNG>> rngs(pool.numThreads());
+
+	//	Iterate over batches, in parallel, with dynamic scheduling
+	pool.parallelFor(numBatches, [&](const size_t batch, const size_t thread)
+	{
+		const long long firstPath = (long long)batch * Nb;
+		const long long lastPath = min<long long>(firstPath + Nb, Np);
+
+        //  The copy of the RNG of this thread
+        auto& cRandom = rngs[thread];
+        if (!cRandom) cRandom = random.clone();
+
+        //  Process the batch
+        double* results = batchResults[batch];
+        mcBatchCV<double>(cModel, cvModel, products, controls, timeline, dateIdx, firstPath, lastPath, *cRandom, results, results + M);
+        for (size_t k = 0; k < M; ++k) results[k] *= lastPath - firstPath;
+	});
+
+    //  Sum over batches, pairwise, so results don't depend on the number of threads
+    PairwiseSum sum(M + M * M);
+    for (long long batch = 0; batch < numBatches; ++batch) sum.add(batchResults[batch]);
+    vector<double> sums(M + M * M);
+    sum.result(sums.data());
+
+    //  Regression
+    mcRegression(K, C, Np, sums.data(), sums.data() + M, beta);
+
+    //  Controlled estimates and their standard errors
+    vector<double> means;
+    for (const auto& control : controls) means.push_back(control.expectation(cvModel));
+    prices.resize(K);
+    for (size_t k = 0; k < K; ++k)
+    {
+        prices[k] = sums[k] / Np;
+        for (size_t c = 0; c < C; ++c) prices[k] -= beta[k][c] * (sums[K + c] / Np - means[c]);
+    }
+    mcCVStdErrs(K, C, Np, Nb, batchResults, beta, means, stdErrs);
+}
+
+//  Parallel prices and risks with control variates,
+//      risks against the model parameters, products in rows, parameters in the order of model.parameters()
+//  Results are independent of the number of threads
+template <template <class> class MODEL, template <class> class PRODUCT, template <class> class CONTROL>
+inline void mcRisksCV(
+    const MODEL<double>&            model,
+    const vector<PRODUCT<double>>&  products,
+    const vector<CONTROL<double>>&  controls,
+    //  Number of paths
+    const long long			        Np,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random,
+	//	Results
+	vector<double>&			        prices,
+	vector<double>&			        stdErrs,
+	matrix<double>&			        risks)
+{
+    //  Merged timeline of products and controls
+    vector<const vector<double>*> timelines;
+    for (const auto& product : products) timelines.push_back(&product.timeline());
+    for (const auto& control : controls) timelines.push_back(&control.timeline());
+    vector<double> timeline;
+    vector<vector<size_t>> dateIdx;
+    mcMergeTimelines(timelines, timeline, dateIdx);
+
+    MODEL<double> cModel = mcInitModel(model, timeline);
+    if (mcInitModel(cModel.controlModel(), timeline).simDim() > cModel.simDim())
+    {
+        throw runtime_error("mcRisksCV: the control model draws more Gaussians than the model");
+    }
+    const size_t K = products.size(), C = controls.size(), M = K + C, P = cModel.parameters().size();
+    //  Sums of payoffs, their risks, M x P, and the cross products of payoffs, M x M
+    const size_t numResults = M + M * P + M * M;
+
+    const long long numBatches = (Np - 1) / Nb + 1;
+
+	//	Initialize the RNG
+	mcInitRNG(random, cModel, timeline);
+
+    //  Copies of the (mutable) RNG, one per thread, made on first use
+    ThreadPool& pool = ThreadPool::instance();
+    vector<unique_ptr<RNG>> rngs(pool.numThreads());
+
+    //  Chunks of batches, summed pairwise, see mcRisksMT
+    long long chunkSize = 1;
+    while (numBatches > chunkSize * (long long)(4 * pool.numThreads())) chunkSize *= 2;
+    const long long numChunks = (numBatches - 1) / chunkSize + 1;
+    vector<PairwiseSum> chunkResults(numChunks, PairwiseSum(numResults));
+
+    //  Sums of payoffs by batch, for the standard errors
+    matrix<double> batchSums(numBatches, M);
+
+	//	Iterate over chunks, in parallel, with dynamic scheduling
+	pool.parallelFor(numChunks, [&](const size_t chunk, const size_t thread)
+	{
+        //  The copy of the RNG of this thread
+        auto& cRandom = rngs[thread];
+        if (!cRandom) cRandom = random.clone();
+
+        //  Accumulator of the chunk
+        PairwiseSum& chunkResult = chunkResults[chunk];
+        static thread_local vector<double> batchResults;
+        batchResults.resize(numResults);
+
+        //  Batches of the chunk
+        const long long firstBatch = (long long)chunk * chunkSize;
+        const long long lastBatch = min(firstBatch + chunkSize, numBatches);
+        for (long long batch = firstBatch; batch < lastBatch; ++batch)
+        {
+		    const long long firstPath = batch * Nb;
+		    const long long lastPath = min<long long>(firstPath + Nb, Np);
+            const double paths = lastPath - firstPath;
+
+	        //	Wipe the tape
+	        tape.clear();
+
+	        //	Put parameters on tape, the control model shares the parameters of the model
+            MODEL<Number> nModel(model);
+            nModel.init(timeline);
+            auto nCvModel = nModel.controlModel();
+            nCvModel.init(timeline);
+            const vector<PRODUCT<Number>> nProducts(products.begin(), products.end());
+            const vector<CONTROL<Number>> nControls(controls.begin(), controls.end());
+
+	        //	Compute the batch
+            vector<Number> nResults(M);
+            mcBatchCV<Number>(nModel, nCvModel, nProducts, nControls, timeline, dateIdx, firstPath, lastPath, *cRandom,
+                nResults.data(), batchResults.data() + M + M * P);
+
+	        //	Back-propagate derivatives, in one sweep for all products and controls
+            matrix<double> adjoints = calculateAdjoints(nResults);
+
+	        //	Pick results
+            const vector<Number*> params = nModel.parameters();
+            for (size_t k = 0; k < M; ++k)
+            {
+                batchResults[k] = batchSums[batch][k] = nResults[k].value * paths;
+                for (size_t i = 0; i < P; ++i) batchResults[M + k * P + i] = adjoints[params[i]->idx][k] * paths;
+            }
+
+            chunkResult.add(batchResults.data());
+        }
+	});
+
+	//	Append the subtrees of the chunks, in order
+    PairwiseSum sum(numResults);
+    for (const auto& chunkResult : chunkResults) sum.add(chunkResult);
+    vector<double> sums(numResults);
+    sum.result(sums.data());
+
+    //  Regression
+    matrix<double> beta;
+    mcRegression(K, C, Np, sums.data(), sums.data() + M + M * P, beta);
+
+    //  Means of the controls and their risks, on tape
+    tape.clear();
+    MODEL<Number> nModel(model);
+    nModel.init(timeline);
+    auto nCvModel = nModel.controlModel();
+    vector<Number> nMeans;
+    for (const auto& control : controls) nMeans.push_back(CONTROL<Number>(control).expectation(nCvModel));
+    const matrix<double> meanAdjoints = calculateAdjoints(nMeans);
+    const vector<Number*> params = nModel.parameters();
+
+    //  Controlled estimates and their risks
+    prices.resize(K);
+    risks.resize(K, P);
+    for (size_t k = 0; k < K; ++k)
+    {
+        prices[k] = sums[k] / Np;
+        for (size_t i = 0; i < P; ++i) risks[k][i] = sums[M + k * P + i] / Np;
+
+        for (size_t c = 0; c < C; ++c)
+        {
+            prices[k] -= beta[k][c] * (sums[K + c] / Np - nMeans[c].value);
+            for (size_t i = 0; i < P; ++i)
+            {
+                risks[k][i] -= beta[k][c] * (sums[M + (K + c) * P + i] / Np - meanAdjoints[params[i]->idx][c]);
+            }
+        }
+    }
+
+    //  Standard errors
+    vector<double> means;
+    for (const auto& nMean : nMeans) means.push_back(nMean.value);
+    mcCVStdErrs(K, C, Np, Nb, batchSums, beta, means, stdErrs);
+
+    tape.clear();
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT, template <class> class CONTROL>
+inline void mcSimulCV(
+    const MODEL<double>&            model,
+    const PRODUCT<double>&          product,
+    const vector<CONTROL<double>>&  controls,
+    const long long			        Np,
+	const int				        Nb,
+    RNG&					        random,
+	double&			                price,
+	double&			                stdErr)
+{
+    vector<double> prices, stdErrs;
+    matrix<double> beta;
+    mcSimulCV(model, vector<PRODUCT<double>>(1, product), controls, Np, Nb, random, prices, stdErrs, beta);
+    price = prices[0];
+    stdErr = stdErrs[0];
+}
+
+template <template <class> class MODEL, template <class> class PRODUCT, template <class> class CONTROL>
+inline void mcRisksCV(
+    const MODEL<double>&            model,
+    const PRODUCT<double>&          product,
+    const vector<CONTROL<double>>&  controls,
+    const long long			        Np,
+	const int				        Nb,
+    RNG&					        random,
+	double&			                price,
+	double&			                stdErr,
+	vector<double>&	                risks)
+{
+    vector<double> prices, stdErrs;
+    matrix<double> productRisks;
+    mcRisksCV(model, vector<PRODUCT<double>>(1, product), controls, Np, Nb, random, prices, stdErrs, productRisks);
+    price = prices[0];
+    stdErr = stdErrs[0];
+    risks.assign(productRisks.begin(), productRisks.end());
+}
+
+//  Multilevel Monte-Carlo
+//  ======================
+
+//  The price of a product on a fine discretization, with a large number of steps, is
+//      E[P_L] = E[P_0] + sum over levels l = 1..L of E[P_l - P_l-1]
+//  where the product of level l refines the event dates of level l - 1, for instance with twice as many monitoring dates
+//  The corrections P_l - P_l-1 are simulated on coupled paths, the coarse Gaussians summed out of the fine ones,
+//      so their variance vanishes with the step, and few paths are needed on the expensive fine levels
+//  The number of paths of every level is optimized for the variance and cost of the level (Giles, 2008),
+//      and levels are added until the estimated bias is below the tolerance,
+//      with a cost close to O(tolerance^-2), against O(tolerance^-3) for standard Monte-Carlo,
+//      when the variances of the corrections decrease at least as fast as the step
+
+//  Coupling requires one Gaussian per step of positive length, like DupireModel, today as an event date is not a step
+
+//  The paths of a level and its coupling with the previous level
+template <class MODEL, class PRODUCT>
+struct mcLevel
+{
+    //  Fine model and product
+    MODEL                   model;
+    PRODUCT                 product;
+    vector<vector<size_t>>  dateIdx;
+    //  Coarse model and product, of the previous level, none on level 0
+    unique_ptr<MODEL>       coarseModel;
+    unique_ptr<PRODUCT>     coarseProduct;
+    vector<vector<size_t>>  coarseDateIdx;
+    //  Fine steps of every coarse step, [coarseEnd[j - 1], coarseEnd[j]), and the weights of their Gaussians,
+    //      the square roots of the fine steps over the coarse step, so the coarse Gaussian is their weighted sum
+    vector<size_t>          coarseEnd;
+    vector<double>          weights;
+    //  End times of the fine steps, one Gaussian each
+    vector<double>          steps;
+    //  Number of event dates, fine and coarse
+    size_t                  numDates;
+    size_t                  coarseNumDates = 0;
+    //  Steps, fine and coarse, a measure of the cost of a path
+    double                  cost;
+
+    mcLevel(const MODEL& m, const PRODUCT& prd, const PRODUCT* coarse)
+        : model(m), product(prd)
+    {
+        vector<double> timeline;
+        mcTimeline(vector<PRODUCT>(1, prd), timeline, dateIdx);
+        model.init(timeline);
+        steps = mcSteps(timeline);
+        if (model.simDim() != steps.size())
+        {
+            throw runtime_error("mcSimulMLMC: the model must draw one Gaussian per step");
+        }
+        numDates = timeline.size();
+        cost = double(steps.size());
+        if (!coarse) return;
+
+        vector<double> coarseTimeline;
+        mcTimeline(vector<PRODUCT>(1, *coarse), coarseTimeline, coarseDateIdx);
+        coarseModel = make_unique<MODEL>(m);
+        coarseModel->init(coarseTimeline);
+        coarseProduct = make_unique<PRODUCT>(*coarse);
+        coarseNumDates = coarseTimeline.size();
+        const vector<double> coarseSteps = mcSteps(coarseTimeline);
+        cost += coarseSteps.size();
+
+        //  Map the coarse steps on the fine ones
+        size_t k = 0;
+        double t = 0.0;
+        for (const double coarseDate : coarseSteps)
+        {
+            const size_t first = k;
+            while (k < steps.size() && steps[k] < coarseDate - 1.0e-12) ++k;
+            if (k == steps.size() || steps[k] > coarseDate + 1.0e-12)
+            {
+                throw runtime_error("mcSimulMLMC: the event dates of every level must refine those of the previous level");
+            }
+            ++k;
+            coarseEnd.push_back(k);
+            const double coarseDt = steps[k - 1] - t;
+            for (size_t i = first; i < k; ++i)
+            {
+                weights.push_back(sqrt((steps[i] - (i ? steps[i - 1] : 0.0)) / coarseDt));
+            }
+            t = steps[k - 1];
+        }
+        //  Fine steps after the last coarse date don't affect the coarse product
+        weights.resize(steps.size(), 0.0);
+    }
+};
+
+//  Average over a batch of paths of the correction P_l - P_l-1, or of P_0 on level 0
+template <class MODEL, class PRODUCT>
+inline double mcBatchLevel(
+    const mcLevel<MODEL, PRODUCT>&  level,
+    //  First and last path
+    const long long                 firstPath,
+    const long long                 lastPath,
+    //  Random number generator, initialized with the dimension of the level
+    RNG&                            random)
+{
+    //  Paths in a block
+    constexpr size_t blockSize = 256;
+
+    //  Working memory: Gaussians by simulation dimension, paths by event date
+    const size_t dim = level.model.simDim(), numDates = level.numDates;
+    const size_t coarseDim = level.coarseEnd.size(), coarseNumDates = max<size_t>(level.coarseNumDates, 1);
+    vector<double> gaussianMemory(dim);
+    matrix<double> gaussians(dim, blockSize), coarseGaussians(max<size_t>(coarseDim, 1), blockSize);
+    matrix<double> paths(numDates, blockSize), coarsePaths(coarseNumDates, blockSize);
+    vector<double> payoffs(blockSize), coarsePayoffs(blockSize);
+
+    //  Integrated variances, only simulated when needed
+    const bool needsVariances = level.product.needsVariances();
+    matrix<double> variances, coarseVariances;
+    if (needsVariances)
+    {
+        variances.resize(numDates, blockSize);
+        coarseVariances.resize(coarseNumDates, blockSize);
+    }
+
+    vector<const double*> productPaths, productVariances, coarseProductPaths, coarseProductVariances;
+    for (const size_t j : level.dateIdx[0])
+    {
+        productPaths.push_back(paths[j]);
+        productVariances.push_back(needsVariances ? variances[j] : nullptr);
+    }
+    if (level.coarseModel) for (const size_t j : level.coarseDateIdx[0])
+    {
+        coarseProductPaths.push_back(coarsePaths[j]);
+        coarseProductVariances.push_back(needsVariances ? coarseVariances[j] : nullptr);
+    }
+
+	//	Set RNG state to the first path in the batch
+	random.skipTo(firstPath);
+
+    //  Loop over blocks
+    double result = 0.0;
+    for (long long first = firstPath; first < lastPath; first += blockSize)
+    {
+        const size_t m = size_t(min<long long>(blockSize, lastPath - first));
+
+        //  Gaussian numbers, transposed into steps x paths
+        for (size_t p = 0; p < m; ++p)
+        {
+            const double* gaussianIncrements = random.nextGPtr(gaussianMemory);
+            for (size_t j = 0; j < dim; ++j) gaussians[j][p] = gaussianIncrements[j];
+        }
+
+        //  Fine paths and payoffs
+        level.model.generatePaths(gaussians, paths, needsVariances ? &variances : nullptr, m);
+        level.product.payoffs(productPaths.data(), productVariances.data(), m, payoffs.data());
+
+        //  Coarse paths on the same Brownian motion, and payoffs
+        if (level.coarseModel)
+        {
+            size_t k = 0;
+            for (size_t j = 0; j < coarseDim; ++j)
+            {
+                double* z = coarseGaussians[j];
+                fill(z, z + m, 0.0);
+                for (; k < level.coarseEnd[j]; ++k)
+                {
+                    const double w = level.weights[k];
+                    const double* fz = gaussians[k];
+                    for (size_t p = 0; p < m; ++p) z[p] += w * fz[p];
+                }
+            }
+            level.coarseModel->generatePaths(coarseGaussians, coarsePaths, needsVariances ? &coarseVariances : nullptr, m);
+            level.coarseProduct->payoffs(coarseProductPaths.data(), coarseProductVariances.data(), m, coarsePayoffs.data());
+            for (size_t p = 0; p < m; ++p) payoffs[p] -= coarsePayoffs[p];
+        }
+
+        for (size_t p = 0; p < m; ++p) result += payoffs[p];
+    }
+
+    return result / double(lastPath - firstPath);
+}
+
+//  Multilevel pricer: products of increasing refinement by level, the finest last,
+//      runs batches of all levels in parallel, in rounds, until the root mean square error,
+//      bias and standard error, falls below a tolerance, or all levels are used
+//  Variances of the levels are estimated from the dispersion of the batch averages of the corrections, see mcSimulAdaptive,
+//      every level starting with minBatches batches
+//  The bias is estimated from the correction of the finest level used, assuming weak convergence at least in the square root of the step
+//  Level l simulates the paths of the RNG from l x maxPaths, so levels are independent
+//  Rounds only depend on the batch results, accumulated in batch order,
+//      so results are reproducible given the RNG, whatever the number of threads
+template <template <class> class MODEL, template <class> class PRODUCT>
+inline void mcSimulMLMC(
+    const MODEL<double>&            model,
+    //  The product on every level, each refining the event dates of the previous one
+    const vector<PRODUCT<double>>&  levelProducts,
+	//	Number of simulations in every batch
+	const int				        Nb,
+    //  Random number generator
+    RNG&					        random,
+    //  Target root mean square error
+    const double                    tolerance,
+    //  Maximum number of paths on every level, rounded up to whole batches
+    const long long                 maxPaths,
+	//	Results
+	double&			                price,
+	double&			                stdErr,
+    //  Paths by level used
+    vector<long long>&              paths)
+{
+    constexpr long long minBatches = 16;
+    if (levelProducts.empty()) throw runtime_error("mcSimulMLMC: no levels");
+
+    const long long maxBatches = max<long long>(1, (maxPaths - 1) / Nb + 1);
+    const long long levelOffset = maxBatches * Nb;
+
+    //  The levels are shared by all threads
+    vector<unique_ptr<mcLevel<MODEL<double>, PRODUCT<double>>>> levels;
+    auto addLevel = [&]()
+    {
+        const size_t l = levels.size();
+        levels.push_back(make_unique<mcLevel<MODEL<double>, PRODUCT<double>>>(
+            model, levelProducts[l], l ? &levelProducts[l - 1] : nullptr));
+    };
+
+    //  Copies of the (mutable) RNG, by thread and level, made on first use
+    ThreadPool& pool = ThreadPool::instance();
+    vector<vector<unique_ptr<RNG>>> rngs(pool.numThreads());
+    for (auto& threadRngs : rngs) threadRngs.resize(levelProducts.size());
+
+    //  Running mean and sum of squared deviations of batch averages, by level, see Welford
+    vector<double> mean, m2;
+    vector<long long> numBatches, nextBatches;
+
+    //  Start with 3 levels, or all of them if fewer
+    for (size_t l = 0; l < min<size_t>(3, levelProducts.size()); ++l)
+    {
+        addLevel();
+        mean.push_back(0.0);
+        m2.push_back(0.0);
+        numBatches.push_back(0);
+        nextBatches.push_back(min(minBatches, maxBatches));
+    }
+
+    //  Variance of the payoff, or the correction, of a level, per path
+    auto variance = [&](const size_t l)
+    {
+        return numBatches[l] > 1 ? Nb * m2[l] / (numBatches[l] - 1) : 0.0;
+    };
+
+    //  Results of the batches of a round
+    vector<pair<size_t, long long>> tasks;
+    vector<double> batchResults;
+
+    for (;;)
+    {
+        //  The batches of the round, level by level
+        tasks.clear();
+        for (size_t l = 0; l < levels.size(); ++l)
+        {
+            for (long long b = numBatches[l]; b < nextBatches[l]; ++b) tasks.emplace_back(l, b);
+        }
+        batchResults.resize(tasks.size());
+
+	    //	Iterate over the batches of all levels, in parallel, with dynamic scheduling
+	    pool.parallelFor(tasks.size(), [&](const size_t task, const size_t thread)
+	    {
+            const size_t l = tasks[task].first;
+            const long long firstPath = (long long)l * levelOffset + tasks[task].second * Nb;
+
+            //  The copy of the RNG of this thread and level
+            auto& cRandom = rngs[thread][l];
+            if (!cRandom)
+            {
+                cRandom = random.clone();
+                cRandom->initSteps(levels[l]->steps);
+            }
+
+            batchResults[task] = mcBatchLevel(*levels[l], firstPath, firstPath + Nb, *cRandom);
+	    });
+
+        //  Accumulate, in batch order
+        for (size_t task = 0; task < tasks.size(); ++task)
+        {
+            const size_t l = tasks[task].first;
+            const long long n = ++numBatches[l];
+            const double delta = batchResults[task] - mean[l];
+            mean[l] += delta / n;
+            m2[l] += delta * (batchResults[task] - mean[l]);
+        }
+
+        //  Optimal numbers of paths, given the variances and costs of the levels:
+        //      N_l proportional to sqrt(V_l / C_l), so the variance of the estimator is tolerance^2 / 2
+        const size_t L = levels.size();
+        double sumVC = 0.0;
+        for (size_t l = 0; l < L; ++l) sumVC += sqrt(variance(l) * levels[l]->cost);
+
+        bool more = false;
+        for (size_t l = 0; l < L; ++l)
+        {
+            const double needed = 2.0 / (tolerance * tolerance) * sqrt(variance(l) / levels[l]->cost) * sumVC;
+            nextBatches[l] = max(numBatches[l], (long long)min(ceil(needed / Nb), double(maxBatches)));
+            more = more || nextBatches[l] > numBatches[l];
+        }
+        if (more) continue;
+
+        //  Bias: the next correction is estimated as at most 1 / sqrt(2) times the last,
+        //      so the remaining bias is at most |E[P_L - P_L-1]| / (sqrt(2) - 1)
+        //  The last 2 corrections are used, for robustness, the one before scaled by 1 / sqrt(2)
+        const double sqrt2 = sqrt(2.0);
+        double bias = 0.0;
+        if (L > 1) bias = fabs(mean[L - 1]);
+        if (L > 2) bias = max(bias, fabs(mean[L - 2]) / sqrt2);
+        bias /= sqrt2 - 1.0;
+
+        if (bias <= tolerance / sqrt2 || L == levelProducts.size()) break;
+
+        //  Add a level
+        addLevel();
+        mean.push_back(0.0);
+        m2.push_back(0.0);
+        numBatches.push_back(0);
+        nextBatches.push_back(min(minBatches, maxBatches));
+    }
+
+    //  Sum the levels
+    price = 0.0;
+    double var = 0.0;
+    paths.resize(levels.size());
+    for (size_t l = 0; l < levels.size(); ++l)
+    {
+        price += mean[l];
+        if (numBatches[l] > 1) var += m2[l] / (numBatches[l] - 1) / numBatches[l];
+        paths[l] = numBatches[l] * Nb;
+    }
+    stdErr = sqrt(var);
+}
@@ -34,11 +34,8 @@ class mrg32k3a : public RNG
 	//  State
     double			myXn, myXn1, myXn2, myYn, myYn1, myYn2;
 
-	//	Antithetic
-	bool			myAnti;
-	//	false: generate new, true: negate cached
-	vector<double>	myCachedUniforms;
-	vector<double>	myCachedGaussians;
+	//	Note: antithetic sampling is not hard-wired here,
+	//		see VarianceReduction in varianceReduction.h
 
     //  Constants
     static constexpr  double	m1 = 4294967087;
@@ -95,9 +92,6 @@ public:
 		//	Reset state
         myXn = myXn1 = myXn2 = myA;
         myYn = myYn1 = myYn2 = myB;
-		
-		//	Anti = false: generate next
-		myAnti = false;
     }
 
     //  Virtual copy constructor
@@ -110,77 +104,23 @@ public:
     void init(const size_t simDim) override      
     {
         myDim = simDim;
-		myCachedUniforms.resize(myDim);
-		myCachedGaussians.resize(myDim);
     }
 
+	//	Generate directly in the caller's vector
 	void nextU(vector<double>& uVec) override
 	{
-		if (myAnti)
-		{
-			//	Do not generate, negate cached
-			transform(
-				myCachedUniforms.begin(),
-				myCachedUniforms.end(),
-				uVec.begin(),
-				[](const double d) { return 1.0 - d; });
-			
-			//	Generate next
-			myAnti = false;
-		}
-		else
-		{
-			//	Generate and cache
-			generate(
-				myCachedUniforms.begin(), 
-				myCachedUniforms.end(), 
-				[this]() { return nextNumber(); });
-			
-			//	Copy
-			copy(
-				myCachedUniforms.begin(),
-				myCachedUniforms.end(),
-				uVec.begin());
-			
-			//	Do not generate next
-			myAnti = true;
-		}
+		generate(
+			uVec.begin(), 
+			uVec.begin() + myDim, 
+			[this]() { return nextNumber(); });
 	}
 
     void nextG(vector<double>& gaussVec) override
     {
-		if (myAnti)
-		{
-			//	Do not generate, negate cached
-			//	Note: we reuse the Gaussian numbers,
-			//		we save not only generation, but also
-			//		Gaussian transaformation
-			transform(
-				myCachedGaussians.begin(),
-				myCachedGaussians.end(),
-				gaussVec.begin(),
-				[](const double n) { return -n; });
-
-			//	Generate next
-			myAnti = false;
-		}
-		else
-		{
-			//	Generate and cache
-			generate(
-				myCachedGaussians.begin(),
-				myCachedGaussians.end(),
-				[this]() { return invNormalCdf(nextNumber()); });
-
-			//	Copy
-			copy(
-				myCachedGaussians.begin(),
-				myCachedGaussians.end(),
-				gaussVec.begin());
-
-			//	Do not generate next
-			myAnti = true;
-		}
+		generate(
+			gaussVec.begin(),
+			gaussVec.begin() + myDim,
+			[this]() { return invNormalCdf(nextNumber()); });
 	}
 
 	//	Skip ahead logic
@@ -189,52 +129,14 @@ public:
 	//		and use 64bit unsigned long long for storage
 
 	//  Skip ahead
-	void skipTo(const unsigned b) override
+	void skipTo(const unsigned long long b) override
 	{
 		//	First reset to 0
 		reset();
 
-		//	How many numbers to skip
-		unsigned skipnums = b * myDim;
-		bool odd = false;
-
-		//	Antithetic: skip only half
-		if (skipnums & 1)
-		{
-			//	Odd
-			odd = true;
-			skipnums = (skipnums - 1) / 2;
-		}
-		else
-		{
-			//	Even
-			skipnums /= 2;
-		}
-
-		//	Skip state
-		skipNumbers(skipnums);
-
-		//	If odd, pre-generate for antithetic
-		if (odd)
-		{
-			myAnti = true;
-
-			//	Uniforms
-			generate(
-				myCachedUniforms.begin(),
-				myCachedUniforms.end(),
-				[this]() { return nextNumber(); });
-
-			//	Gaussians
-			generate(
-				myCachedGaussians.begin(),
-				myCachedGaussians.end(),
-				[this]() { return invNormalCdf(nextNumber()); });
-		}
-		else
-		{
-			myAnti = false;
-		}
+		//	Skip b paths of myDim numbers, 
+		//		in 64bit so b * myDim cannot overflow
+		skipNumbers(b * myDim);
 	}
 
 private:
@@ -303,93 +205,108 @@ private:
 		}
 	}
 
-	void skipNumbers(const unsigned b) 
-    {
-        if ( b <= 0) return;
-        unsigned skip = b;
-
-		static constexpr unsigned long long
-			m1l = unsigned long long(m1);
-		static constexpr unsigned long long
-			m2l = unsigned long long(m2);
+	//	Precomputed A^(2^k) and B^(2^k) for k = 0 to 63
+	//	so a skip costs one matrix by vector product per bit set in the skip
+	struct SkipTable
+	{
+		unsigned long long A[64][3][3];
+		unsigned long long B[64][3][3];
 
-		unsigned long long Ab[3][3] = {
-            { 1, 0 ,0 },        
-            { 0, 1, 0 },
-            { 0, 0, 1 }
-        },
-            Bb[3][3] = {
-                { 1, 0 ,0 },    
-                { 0, 1, 0 },
-                { 0, 0, 1 }
-        },
-            Ai[3][3] = {        //  A0 = A
-                { 
+		SkipTable()
+		{
+			//	A0 = A
+			unsigned long long A0[3][3] = {
+				{ 
 					0, 
-					unsigned long long (a12) , 
-					unsigned long long (m1 - a13) 
+					(unsigned long long)(a12), 
+					(unsigned long long)(m1 - a13) 
 					//	m1 - a13 instead of -a13
 					//	so results are always positive
 					//	and we can use unsigned long longs
 					//	after modulus, we get the same results
 				},
-                { 1, 0, 0 },
-                { 0, 1, 0 }
-        },
-            Bi[3][3] = {        //  B0 = B
-                { 
-					unsigned long long (a21), 
+				{ 1, 0, 0 },
+				{ 0, 1, 0 }
+			};
+			//	B0 = B
+			unsigned long long B0[3][3] = {
+				{ 
+					(unsigned long long)(a21), 
 					0 , 
-					unsigned long long (m2 - a23) 
+					(unsigned long long)(m2 - a23) 
 					//	same logic: m2 - a32
 				},
-                { 1, 0, 0 },
-                { 0, 1, 0 }
-        };
+				{ 1, 0, 0 },
+				{ 0, 1, 0 }
+			};
 
-        while (skip>0) 
-        {
-            if (skip & 1)   //  i.e. ai == 1
-            {
-                //  accumulate Ab and Bb
-                mPrd(Ab, Ai, m1l, Ab);
-                mPrd(Bb, Bi, m2l, Bb);
-            }
-
-            //  Recursion on Ai and Bi 
-            mPrd(Ai, Ai, m1l, Ai);
-            mPrd(Bi, Bi, m2l, Bi);
-
-            skip >>= 1;
-        }
-
-        //  Final result
-		unsigned long long X0[3] =
+			for (int j = 0; j < 3; ++j) for (int k = 0; k < 3; ++k)
+			{
+				A[0][j][k] = A0[j][k];
+				B[0][j][k] = B0[j][k];
+			}
+
+			//	Recursion on squares
+			for (int i = 1; i < 64; ++i)
+			{
+				mPrd(A[i - 1], A[i - 1], (unsigned long long)(m1), A[i]);
+				mPrd(B[i - 1], B[i - 1], (unsigned long long)(m2), B[i]);
+			}
+		}
+	};
+
+	//	Built once, on first use, thread safe
+	static const SkipTable& skipTable()
+	{
+		static const SkipTable table;
+		return table;
+	}
+
+	void skipNumbers(const unsigned long long b) 
+    {
+        if ( b <= 0) return;
+        unsigned long long skip = b;
+
+		static constexpr unsigned long long
+			m1l = (unsigned long long)(m1);
+		static constexpr unsigned long long
+			m2l = (unsigned long long)(m2);
+
+		const SkipTable& table = skipTable();
+
+		//	Initial state
+		unsigned long long X[3] =
         {
-			unsigned long long (myXn),
-			unsigned long long (myXn1),
-			unsigned long long (myXn2)
+			(unsigned long long)(myXn),
+			(unsigned long long)(myXn1),
+			(unsigned long long)(myXn2)
         },
-            Y0[3] =
+            Y[3] =
         {
-			unsigned long long (myYn),
-			unsigned long long (myYn1),
-			unsigned long long (myYn2)
+			(unsigned long long)(myYn),
+			(unsigned long long)(myYn1),
+			(unsigned long long)(myYn2)
         },
             temp[3];
-        
-		//	From initial to final state
-        vPrd(Ab, X0, m1l, temp);
-        
-		//	Convert back to doubles
-		myXn = double(temp[0]);
-        myXn1 = double(temp[1]);
-        myXn2 = double(temp[2]);
 
-		//	Same for Y
-        vPrd(Bb, Y0, m2l, temp);
-        myYn = double(temp[0]);
-        myYn1 = double(temp[1]);
-        myYn2 = double(temp[2]);
+		//	Apply A^(2^i) and B^(2^i) for every bit i set in the skip
+		for (int i = 0; skip > 0; ++i, skip >>= 1)
+		{
+			if (skip & 1)
+			{
+				vPrd(table.A[i], X, m1l, temp);
+				copy(temp, temp + 3, X);
+				vPrd(table.B[i], Y, m2l, temp);
+				copy(temp, temp + 3, Y);
+			}
+		}
+
+        //  Final result, converted back to doubles
+		myXn = double(X[0]);
+        myXn1 = double(X[1]);
+        myXn2 = double(X[2]);
+        myYn = double(Y[0]);
+        myYn1 = double(Y[1]);
+        myYn2 = double(Y[2]);
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+//  Implementation of the Philox4x32-10 counter-based RNG
+//  Salmon, Moraes, Dror and Shaw,
+//      Parallel Random Numbers: As Easy as 1, 2, 3, SC11, 2011
+
+//  The random numbers of dimension dim on path p
+//      are a pure function of the key (seed) and the counter (p, dim)
+//  So skipping is free, clones are trivial
+//      and generation vectorizes across paths
+
+#include "random.h"
+#include "gaussians.h"
+#include "matrix.h"
+
+class Philox : public RNG
+{
+    //  Key (seed)
+    const unsigned      myKey0, myKey1;
+
+    //  Dimension
+    size_t              myDim;
+
+    //  Current path: the only state
+    unsigned long long  myPath;
+
+    //  Constants
+    static constexpr unsigned M0 = 0xD2511F53;
+    static constexpr unsigned M1 = 0xCD9E8D57;
+    static constexpr unsigned W0 = 0x9E3779B9;
+    static constexpr unsigned W1 = 0xBB67AE85;
+    //  Uniforms in the middle of 2^-32 intervals so we never hit 0 or 1
+    static constexpr double     twoPowM32 = 1.0 / 4294967296.0;
+
+    static unsigned mulhilo(const unsigned a, const unsigned b, unsigned& hi)
+    {
+        const unsigned long long p = (unsigned long long)a * b;
+        hi = unsigned(p >> 32);
+        return unsigned(p);
+    }
+
+public:
+
+    //  Block of 4 random 32bit integers for counter (c0, c1, c2, c3) and key (k0, k1)
+    //  10 rounds
+    static void philox(
+        unsigned        c0,
+        unsigned        c1,
+        unsigned        c2,
+        unsigned        c3,
+        unsigned        k0,
+        unsigned        k1,
+        unsigned        out[4])
+    {
+        for (int round = 0; round < 10; ++round)
+        {
+            unsigned hi0, hi1;
+            const unsigned lo0 = mulhilo(M0, c0, hi0);
+            const unsigned lo1 = mulhilo(M1, c2, hi1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+            //  Bump key
+            k0 += W0;
+            k1 += W1;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+
+    //  Constructor with seed
+    Philox(const unsigned a = 12345, const unsigned b = 12346) :
+        myKey0(a), myKey1(b), myDim(0), myPath(0) {}
+
+    //  Virtual copy constructor
+    unique_ptr<RNG> clone() const override
+    {
+        return make_unique<Philox>(*this);
+    }
+
+    //  Initializer
+    void init(const size_t simDim) override
+    {
+        myDim = simDim;
+        myPath = 0;
+    }
+
+    //  Uniform numbers of dimensions 0 to dim - 1 on path p, passed to func(d, u)
+    //  Counter: c0 = block of 4 dimensions, c1 = 0, (c2, c3) = 64bit path index
+    template <class F>
+    void generate(const unsigned long long path, const size_t dim, F&& func) const
+    {
+        unsigned out[4];
+        for (size_t d = 0; d < dim; d += 4)
+        {
+            philox(unsigned(d >> 2), 0, unsigned(path), unsigned(path >> 32), myKey0, myKey1, out);
+            const size_t n = min<size_t>(4, dim - d);
+            for (size_t k = 0; k < n; ++k)
+            {
+                func(d + k, (out[k] + 0.5) * twoPowM32);
+            }
+        }
+    }
+
+	void nextU(vector<double>& uVec) override
+	{
+        generate(myPath, myDim, [&](const size_t d, const double u) { uVec[d] = u; });
+        ++myPath;
+	}
+
+    void nextG(vector<double>& gaussVec) override
+    {
+        generate(myPath, myDim, [&](const size_t d, const double u) { gaussVec[d] = invNormalCdf(u); });
+        ++myPath;
+    }
+
+    //  Block generation for paths firstPath to firstPath + g.cols() - 1
+    //      in the (dimension x paths) matrix g, g[dim][path]
+    //  Pure function of the key, so const and thread safe
+    //  The inner loops are over paths, so they vectorize
+    void blockU(const unsigned long long firstPath, matrix<double>& u) const
+    {
+        const size_t Np = u.cols(), dim = u.rows();
+        for (size_t d = 0; d < dim; d += 4)
+        {
+            const size_t n = min<size_t>(4, dim - d);
+            for (size_t p = 0; p < Np; ++p)
+            {
+                const unsigned long long path = firstPath + p;
+                unsigned out[4];
+                philox(unsigned(d >> 2), 0, unsigned(path), unsigned(path >> 32), myKey0, myKey1, out);
+                for (size_t k = 0; k < n; ++k) u[d + k][p] = (out[k] + 0.5) * twoPowM32;
+            }
+        }
+    }
+
+    void blockG(const unsigned long long firstPath, matrix<double>& g) const
+    {
+        blockU(firstPath, g);
+        for (size_t d = 0; d < g.rows(); ++d)
+        {
+            double* row = g[d];
+            for (size_t p = 0; p < g.cols(); ++p) row[p] = invNormalCdf(row[p]);
+        }
+    }
+
+    //  Skip ahead: free
+    void skipTo(const unsigned long long b) override
+    {
+        myPath = b;
+    }
+};
@@ -14,15 +14,33 @@ public:
     //  Initialise with dimension simDim
     virtual void init(const size_t simDim) = 0;
 
+    //  Initialise with the (increasing, positive) end times of the simulation steps, one dimension each
+    //  Only path constructions, like the Brownian bridge, use the times, by default only the dimension matters
+    virtual void initSteps(const vector<double>& stepTimes)
+    {
+        init(stepTimes.size());
+    }
+
     //  Compute the next vector[simDim] of independent Uniforms or Gaussians
     //  The vector is filled by the function and must be pre-allocated
 	virtual void nextU(vector<double>& uVec) = 0;
 	virtual void nextG(vector<double>& gaussVec) = 0;
 
+    //  Same as nextG, but returns a pointer on the next vector[simDim] of Gaussians
+    //  RNGs that hold their numbers in memory return them directly, without copy
+    //  By default, fills the working memory gaussVec and returns its data
+    //  The pointer is only valid until the next call
+    virtual const double* nextGPtr(vector<double>& gaussVec)
+    {
+        nextG(gaussVec);
+        return gaussVec.data();
+    }
+
     virtual unique_ptr<RNG> clone() const = 0;
 
     virtual ~RNG() {}
 
-    //  Skip ahead
-    virtual void skipTo(const unsigned b) = 0;
+    //  Skip ahead to path b
+    //  64bit, so path counts may scale into the billions, across machines
+    virtual void skipTo(const unsigned long long b) = 0;
 };
@@ -0,0 +1,121 @@
+#pragma once
+
+//  Deterministic parallel reductions
+//  =================================
+
+//  Sums of batch results, like prices or vegas,
+//      pairwise along a fixed binary tree over the batch indices:
+//      node (k, i) is the sum of the batches in [i * 2^k, (i + 1) * 2^k),
+//      the sum of its children (k - 1, 2i) and (k - 1, 2i + 1), left plus right
+//  Pairwise summation is more accurate than a running sum (errors grow in log(n) rather than n)
+//      and, since the tree only depends on the number of batches,
+//      the results are bit-identical whatever the number of threads and the schedule
+
+//  PairwiseSum is a streaming accumulator: batches are added left to right,
+//      and complete subtrees are summed as soon as possible,
+//      so it holds at most log2(n) + 1 partial sums at a time
+//  Subtrees may be summed on different threads, in separate accumulators,
+//      over ranges of batches that start on a multiple of a power of 2 (a chunk size),
+//      then appended, in order, to reproduce the sum over all batches
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+class PairwiseSum
+{
+    //  Size of the summed vectors
+    size_t                  mySize;
+
+    //  Stack of partial sums of complete subtrees, left to right, and their levels (log2 of size)
+    vector<vector<double>>  myPartials;
+    vector<int>             myLevels;
+    size_t                  myDepth;
+
+    //  Push a partial sum on the stack, then merge complete subtrees
+    template <class F>
+    void push(const int level, F&& fill)
+    {
+        if (myPartials.size() <= myDepth)
+        {
+            myPartials.emplace_back(mySize);
+            myLevels.push_back(0);
+        }
+        fill(myPartials[myDepth].data());
+        myLevels[myDepth] = level;
+        ++myDepth;
+
+        //  Merge the top 2 subtrees while they are siblings, left plus right
+        while (myDepth >= 2 && myLevels[myDepth - 1] == myLevels[myDepth - 2])
+        {
+            double* left = myPartials[myDepth - 2].data();
+            const double* right = myPartials[myDepth - 1].data();
+            for (size_t i = 0; i < mySize; ++i) left[i] += right[i];
+            ++myLevels[myDepth - 2];
+            --myDepth;
+        }
+    }
+
+public:
+
+    explicit PairwiseSum(const size_t size = 1) : mySize(size), myDepth(0) {}
+
+    size_t size() const { return mySize; }
+
+    //  Start over
+    void clear() { myDepth = 0; }
+
+    //  Add the next batch, an array of size()
+    void add(const double* x)
+    {
+        push(0, [&](double* p) { copy(x, x + mySize, p); });
+    }
+
+    //  Add the next batch, scalar
+    void add(const double x)
+    {
+        add(&x);
+    }
+
+    //  Append the subtrees of another accumulator, which summed the following batches
+    //  The first batch of rhs must be a multiple of 2^(level of its first subtree),
+    //      for instance when rhs is a chunk of a fixed power of 2 size
+    void add(const PairwiseSum& rhs)
+    {
+        for (size_t d = 0; d < rhs.myDepth; ++d)
+        {
+            const vector<double>& partial = rhs.myPartials[d];
+            push(rhs.myLevels[d], [&](double* p) { copy(partial.begin(), partial.end(), p); });
+        }
+    }
+
+    //  The sum, in an array of size()
+    //  Incomplete trees are summed right to left: the remaining subtrees are decreasing in size,
+    //      so this is the sum at the root of the tree padded with zeros
+    void result(double* res) const
+    {
+        fill(res, res + mySize, 0.0);
+        for (size_t d = myDepth; d-- > 0;)
+        {
+            const double* p = myPartials[d].data();
+            for (size_t i = 0; i < mySize; ++i) res[i] = p[i] + res[i];
+        }
+    }
+
+    //  The sum, scalar, when size() is 1
+    double result() const
+    {
+        double res;
+        result(&res);
+        return res;
+    }
+};
+
+//  Pairwise sum of a sequence of scalars
+template <class IT>
+inline double pairwiseSum(IT begin, IT end)
+{
+    PairwiseSum sum;
+    for (auto it = begin; it != end; ++it) sum.add(double(*it));
+    return sum.result();
+}
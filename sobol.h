@@ -23,9 +23,14 @@ As long as this comment is preserved at the top of the file
 #include "random.h"
 #include "gaussians.h"
 
+#include <string.h>
+#include <stdexcept>
+#include <random>
+
 #define ONEOVER2POW32 2.3283064365387E-10
 
-const unsigned * const * getjkDir();
+//  Direction numbers, built lazily in sobol.cpp for dimensions 0 to dim - 1
+const unsigned * const * getjkDir(const size_t dim);
 
 class Sobol : public RNG
 {
@@ -45,6 +50,103 @@ class Sobol : public RNG
 
 public:
 
+    //  Randomization, for error estimates and independent replications
+    //  digitalShift: XOR a random 32bit shift into every dimension
+    //  lms: random linear matrix scrambling of the direction numbers 
+    //      followed by a digital shift, see Matousek, 1998
+    //      this is the practical alternative to Owen's nested scrambling
+    //      with the same variance properties for smooth integrands
+    //  Randomized sequences remain digital nets, so skipping is unaffected
+    enum class Scrambling { none, digitalShift, lms };
+
+private:
+
+    //  Randomization
+    Scrambling                  myScrambling;
+    unsigned                    mySeed;
+    //  Random digital shift by dimension, empty if none
+    vector<unsigned>            myShift;
+    //  Scrambled direction numbers, i-th number of dimension dim in [i * myDim + dim]
+    //  empty if not scrambled, in which case we use jkDir
+    vector<unsigned>            myScrambledDir;
+    //  Offset to the centre of the 2^-32 interval when randomized,
+    //      so we never hit 0
+    double                      myOffset;
+
+    //  The i-th direction numbers for all dimensions
+    const unsigned* dirNums(const size_t i) const
+    {
+        return myScrambledDir.empty() ? jkDir[i] : &myScrambledDir[i * myDim];
+    }
+
+    //  Parity of the number of bits in x
+    static unsigned parity(unsigned x)
+    {
+        x ^= x >> 16;
+        x ^= x >> 8;
+        x ^= x >> 4;
+        x ^= x >> 2;
+        x ^= x >> 1;
+        return x & 1;
+    }
+
+    //  Draw the randomization
+    void randomize()
+    {
+        myShift.clear();
+        myScrambledDir.clear();
+        myOffset = 0.0;
+        if (myScrambling == Scrambling::none) return;
+
+        //  Use a different seed for every independent replication
+        mt19937_64 gen(mySeed);
+        myOffset = 0.5;
+
+        //  Digital shift
+        myShift.resize(myDim);
+        for (auto& shift : myShift) shift = unsigned(gen() >> 32);
+
+        if (myScrambling != Scrambling::lms) return;
+
+        //  Linear matrix scrambling
+        //  For every dimension, draw a random lower triangular bit matrix L with unit diagonal,
+        //      where digit k (k = 0 is the most significant bit) of the scrambled number
+        //      is the parity of the digits 0 to k masked by row k of L
+        myScrambledDir.resize(32 * myDim);
+        unsigned rows[32];
+        for (size_t d = 0; d < myDim; ++d)
+        {
+            for (unsigned k = 0; k < 32; ++k)
+            {
+                const unsigned bit = 1u << (31 - k);
+                //  Diagonal + random digits strictly more significant
+                rows[k] = bit | (unsigned(gen() >> 32) & ~(bit | (bit - 1)));
+            }
+
+            for (size_t i = 0; i < 32; ++i)
+            {
+                const unsigned v = jkDir[i][d];
+                unsigned sv = 0;
+                for (unsigned k = 0; k < 32; ++k)
+                {
+                    sv |= parity(v & rows[k]) << (31 - k);
+                }
+                myScrambledDir[i * myDim + d] = sv;
+            }
+        }
+    }
+
+public:
+
+    //  Maximum dimension, see sobol.cpp
+    static constexpr size_t maxDim = 21201;
+
+    //  Constructor, plain Sobol by default
+    //  Randomized sequences with different seeds are independent replications
+    Sobol(const Scrambling scrambling = Scrambling::none, const unsigned seed = 12345) :
+        myDim(0), myIndex(0), jkDir(nullptr), 
+        myScrambling(scrambling), mySeed(seed), myOffset(0.0) {}
+
     //  Virtual copy constructor
     unique_ptr<RNG> clone() const override
     {
@@ -54,21 +156,33 @@ public:
     //  Initializer 
     void init(const size_t simDim) override
     {
-        //  Set pointer on direction numbers 
-        jkDir = getjkDir();
+        //  Check dimension
+        if (simDim > maxDim)
+        {
+            throw runtime_error("Sobol: dimension exceeds the maximum of 21201");
+        }
+
+        //  Set pointer on direction numbers, 
+        //      built on first request 
+        jkDir = getjkDir(simDim);
 
         //  Dimension
         myDim = simDim;
         myState.resize(myDim);
 
+        //  Randomize
+        randomize();
+
         //  Reset to 0
         reset();
     }
 
     void reset()
     {
-        //  Set state to 0
-        memset(myState.data(), 0, myDim * sizeof(unsigned));
+        //  Set state to 0, or the digital shift when randomized
+        //  The shift is then carried through by the XOR recursion
+        if (myShift.empty()) memset(myState.data(), 0, myDim * sizeof(unsigned));
+        else copy(myShift.begin(), myShift.end(), myState.begin());
         //  Set index to 0
         myIndex = 0;
     }
@@ -86,13 +200,13 @@ public:
 		}
 
         //  Direction numbers
-        const unsigned* dirNums = jkDir[j];
+        const unsigned* dir = dirNums(j);
 
 		//	XOR the appropriate direction number 
 		//		into each component of the integer sequence
         for (int i = 0; i<myDim; ++i)
 		{
-			myState[i] ^= dirNums[i];
+			myState[i] ^= dir[i];
 		}
 
 		//	Update count
@@ -102,40 +216,49 @@ public:
 	void nextU(vector<double>& uVec) override
 	{
 		next();
+		const double offset = myOffset;
 		transform(myState.begin(), myState.end(), uVec.begin(),
-			[](const unsigned long i) 
-				{return ONEOVER2POW32 * i; });
+			[offset](const unsigned long i) 
+				{return ONEOVER2POW32 * (i + offset); });
 	}
 
 	void nextG(vector<double>& gaussVec) override
     {
 		next();
+		const double offset = myOffset;
 		transform(myState.begin(), myState.end(), gaussVec.begin(),
-			[](const unsigned long i) 
-				{return invNormalCdf(ONEOVER2POW32 * i); });
+			[offset](const unsigned long i) 
+				{return invNormalCdf(ONEOVER2POW32 * (i + offset)); });
     }
 
     //  Skip ahead (from 0 to b)
-    void skipTo(const unsigned b) override
+    void skipTo(const unsigned long long b) override
     {
         //	Check skip
-        if (!b) return;
+        //  With 32 direction numbers, the sequence has 2^32 points
+        if (b >> 32)
+        {
+            throw runtime_error("Sobol: cannot skip beyond 2^32 points");
+        }
 
         //	Reset Sobol to 0 
         reset();
+        if (!b) return;
 
         //	The actual Sobol skipping algo
-        unsigned im = b;
-        unsigned two_i = 1, two_i_plus_one = 2;
+        //  64bit, so two_i_plus_one doesn't overflow for b >= 2^31
+        const unsigned long long im = b;
+        unsigned long long two_i = 1, two_i_plus_one = 2;
 
         unsigned i = 0;
         while (two_i <= im)
         {
             if (((im + two_i) / two_i_plus_one) & 1)
             {
+                const unsigned* dir = dirNums(i);
                 for (unsigned k = 0; k<myDim; ++k)
                 {
-                    myState[k] ^= jkDir[i][k];
+                    myState[k] ^= dir[k];
                 }
             }
 
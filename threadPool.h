@@ -0,0 +1,321 @@
+#pragma once
+
+//  Persistent thread pool with work stealing
+//  =========================================
+
+//  The threads are started once and sleep between jobs,
+//      so repeated calls (from Excel) don't pay for the creation of a team of threads
+//  Thread local objects, like the AAD tape, live in the pool threads across calls,
+//      so their memory is reused
+
+//  A job is a loop over tasks 0 to n - 1, for instance the batches of a simulation
+//  The tasks are initially distributed in contiguous ranges, one per thread,
+//      every thread processes its own range from the front,
+//      and steals half of the remaining range of another thread when done,
+//      so threads don't idle at the tail when task costs are uneven, as with knock-outs
+
+//  The calling thread participates in the job as thread 0,
+//      calls from within a job run serially on the calling thread
+//  In a DLL, stop the pool before unloading (xlAutoClose), rather than joining threads on exit
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <algorithm>
+using namespace std;
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+class ThreadPool
+{
+    //  Remaining range of tasks of a thread, stolen from the back
+    struct Range
+    {
+        mutex       myMutex;
+        size_t      myBegin = 0;
+        size_t      myEnd = 0;
+    };
+
+    //  Worker threads, 1 to numThreads - 1
+    vector<thread>              myThreads;
+    //  Ranges, by thread number, including the caller's
+    unique_ptr<Range[]>         myRanges;
+    size_t                      myNumThreads = 1;
+
+    //  Current job
+    function<void(size_t, size_t)>  myJob;
+    exception_ptr               myException;
+    mutex                       myExceptionMutex;
+
+    //  Synchronization of workers
+    mutex                       myMutex;
+    condition_variable          myStart;
+    condition_variable          myDone;
+    //  Incremented on every job, so workers know there is work
+    size_t                      myGeneration = 0;
+    size_t                      myActive = 0;
+    bool                        myStop = false;
+
+    //  One job at a time
+    mutex                       myJobMutex;
+
+    //  Thread number, 0 on the caller
+    static size_t& threadIdx()
+    {
+        static thread_local size_t idx = 0;
+        return idx;
+    }
+
+    //  True while a thread executes a job
+    static bool& inJob()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    //  Pin the calling thread to a core
+    static void pin(const size_t core)
+    {
+#ifdef _WIN32
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (core % (8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core % CPU_SETSIZE, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)core;
+#endif
+    }
+
+    //  Next task for thread t: from its own range, or stolen, false when there is no work left
+    bool nextTask(const size_t t, size_t& task)
+    {
+        //  Own range, from the front
+        {
+            Range& own = myRanges[t];
+            lock_guard<mutex> lk(own.myMutex);
+            if (own.myBegin < own.myEnd)
+            {
+                task = own.myBegin++;
+                return true;
+            }
+        }
+
+        //  Steal half of the largest remaining range of another thread, from the back
+        for (;;)
+        {
+            size_t victim = t, largest = 0;
+            for (size_t v = 0; v < myNumThreads; ++v)
+            {
+                if (v == t) continue;
+                Range& r = myRanges[v];
+                lock_guard<mutex> lk(r.myMutex);
+                if (r.myEnd - r.myBegin > largest)
+                {
+                    largest = r.myEnd - r.myBegin;
+                    victim = v;
+                }
+            }
+            if (!largest) return false;
+
+            size_t begin, end;
+            {
+                Range& r = myRanges[victim];
+                lock_guard<mutex> lk(r.myMutex);
+                const size_t left = r.myEnd - r.myBegin;
+                //  Emptied in the meantime, try again
+                if (!left) continue;
+                const size_t stolen = (left + 1) / 2;
+                end = r.myEnd;
+                begin = end - stolen;
+                r.myEnd = begin;
+            }
+
+            //  First stolen task for us, the rest in our range, where others may steal it
+            Range& own = myRanges[t];
+            lock_guard<mutex> lk(own.myMutex);
+            own.myBegin = begin + 1;
+            own.myEnd = end;
+            task = begin;
+            return true;
+        }
+    }
+
+    //  Thread t processes tasks until there are none left
+    void work(const size_t t)
+    {
+        inJob() = true;
+        size_t task;
+        while (nextTask(t, task))
+        {
+            try
+            {
+                myJob(task, t);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lk(myExceptionMutex);
+                if (!myException) myException = current_exception();
+            }
+        }
+        inJob() = false;
+    }
+
+    //  Loop of the worker threads
+    //  generation is the one at the start of the thread, so jobs started later are not missed
+    void workerLoop(const size_t t, const bool affinity, size_t generation)
+    {
+        threadIdx() = t;
+        if (affinity) pin(t);
+
+        for (;;)
+        {
+            {
+                unique_lock<mutex> lk(myMutex);
+                myStart.wait(lk, [&] { return myStop || myGeneration != generation; });
+                if (myStop) return;
+                generation = myGeneration;
+            }
+
+            work(t);
+
+            {
+                lock_guard<mutex> lk(myMutex);
+                if (--myActive == 0) myDone.notify_all();
+            }
+        }
+    }
+
+    //  Starts with the number of hardware threads
+    ThreadPool()
+    {
+        start();
+    }
+
+public:
+
+    //  The pool of the library
+    static ThreadPool& instance()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool()
+    {
+        stop();
+    }
+
+    //  (Re)starts with a number of threads, including the caller, 0 for the number of hardware threads
+    //  With affinity, thread t is pinned to core t, the caller excepted
+    void start(size_t numThreads = 0, const bool affinity = false)
+    {
+        lock_guard<mutex> job(myJobMutex);
+        stopThreads();
+
+        if (!numThreads) numThreads = max<size_t>(1, thread::hardware_concurrency());
+        myNumThreads = numThreads;
+        myRanges = make_unique<Range[]>(numThreads);
+
+        myStop = false;
+        for (size_t t = 1; t < numThreads; ++t)
+        {
+            myThreads.emplace_back(&ThreadPool::workerLoop, this, t, affinity, myGeneration);
+        }
+    }
+
+    //  Stops the worker threads, jobs then run on the caller
+    void stop()
+    {
+        lock_guard<mutex> job(myJobMutex);
+        stopThreads();
+        myNumThreads = 1;
+        myRanges = make_unique<Range[]>(1);
+    }
+
+    //  Number of threads, including the caller
+    size_t numThreads() const { return myNumThreads; }
+
+    //  Number of the calling thread in the pool, in [0, numThreads()), 0 outside the pool
+    static size_t threadNum() { return threadIdx(); }
+
+    //  Executes func(task, thread) for tasks 0 to n - 1, in parallel, returns when all tasks are done
+    //  thread is the number of the executing thread, for the indexing of per-thread working memory
+    //  Rethrows the first exception thrown by a task, once all the tasks are done
+    template <class F>
+    void parallelFor(const size_t n, F&& func)
+    {
+        //  Serial: no workers, nested job or single task
+        if (myNumThreads == 1 || inJob() || n <= 1)
+        {
+            const size_t t = threadIdx();
+            for (size_t task = 0; task < n; ++task) func(task, t);
+            return;
+        }
+
+        lock_guard<mutex> job(myJobMutex);
+
+        //  Distribute the tasks in contiguous ranges
+        const size_t T = myNumThreads;
+        for (size_t t = 0; t < T; ++t)
+        {
+            lock_guard<mutex> lk(myRanges[t].myMutex);
+            myRanges[t].myBegin = n * t / T;
+            myRanges[t].myEnd = n * (t + 1) / T;
+        }
+
+        myJob = [&func](const size_t task, const size_t t) { func(task, t); };
+        myException = nullptr;
+
+        //  Wake up workers
+        {
+            lock_guard<mutex> lk(myMutex);
+            myActive = T - 1;
+            ++myGeneration;
+        }
+        myStart.notify_all();
+
+        //  Participate as thread 0
+        work(0);
+
+        //  Wait for workers
+        {
+            unique_lock<mutex> lk(myMutex);
+            myDone.wait(lk, [&] { return myActive == 0; });
+        }
+
+        myJob = nullptr;
+        if (myException) rethrow_exception(myException);
+    }
+
+private:
+
+    void stopThreads()
+    {
+        {
+            lock_guard<mutex> lk(myMutex);
+            myStop = true;
+        }
+        myStart.notify_all();
+        for (auto& t : myThreads) t.join();
+        myThreads.clear();
+    }
+};
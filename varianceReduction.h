@@ -0,0 +1,213 @@
+#pragma once
+
+//  Variance reduction over any RNG
+//  ===============================
+
+//  Antithetic sampling, moment matching and stratification of the first dimension,
+//      see Glasserman, Monte Carlo Methods in Financial Engineering, chapter 4
+//  Implemented as an RNG adapter, so it composes with any generator,
+//      including the Brownian bridge (apply the bridge on top for stratification of the terminal point)
+//  Meant for pseudo-random generators: Sobol is already (much better) stratified
+
+//  Paths are produced in blocks of blockSize, aligned on multiples of blockSize in the path index
+//  So results are deterministic given the block size, irrespective of batches and skips
+
+#include "random.h"
+#include "gaussians.h"
+
+class VarianceReduction : public RNG
+{
+    //  Underlying RNG
+    unique_ptr<RNG>         myRng;
+
+    //  Options
+    const bool              myAntithetic;
+    const bool              myMomentMatching;
+    const bool              myStratified;
+    const size_t            myBlockSize;
+
+    //  Dimension
+    size_t                  myDim;
+
+    //  Current block, one vector per path
+    vector<vector<double>>  myBlock;
+    //  Index of the block
+    unsigned long long      myBlockIdx;
+    //  Next path in the block
+    size_t                  myPos;
+    //  Contents of the block
+    enum class Kind { none, uniforms, gaussians };
+    Kind                    myKind;
+
+    //  Fill block b with uniforms or Gaussians
+    void fill(const unsigned long long b, const Kind kind)
+    {
+        const size_t B = myBlockSize;
+
+        //  Lazy allocation
+        myBlock.resize(B);
+        for (auto& path : myBlock) path.resize(myDim);
+
+        //  Antithetic: the underlying RNG only produces the first path of every pair
+        const size_t n = myAntithetic ? B / 2 : B;
+        myRng->skipTo(b * n);
+
+        for (size_t p = 0; p < n; ++p)
+        {
+            vector<double>& path = myAntithetic ? myBlock[2 * p] : myBlock[p];
+
+            //  Stratification: the first number of path p in the p-th of B strata
+            //  The antithetic of stratum p is stratum B - 1 - p, so all strata are covered
+            //  The uniform is stratified before it is turned into a Gaussian, so the strata are exact
+            if (myStratified && myDim)
+            {
+                myRng->nextU(path);
+                path[0] = (p + path[0]) / B;
+                if (kind == Kind::gaussians)
+                {
+                    for (auto& x : path) x = invNormalCdf(x);
+                }
+            }
+            else if (kind == Kind::gaussians) myRng->nextG(path);
+            else myRng->nextU(path);
+
+            //  Antithetic
+            if (myAntithetic)
+            {
+                vector<double>& anti = myBlock[2 * p + 1];
+                if (kind == Kind::gaussians)
+                {
+                    transform(path.begin(), path.end(), anti.begin(), [](const double x) { return -x; });
+                }
+                else
+                {
+                    transform(path.begin(), path.end(), anti.begin(), [](const double x) { return 1.0 - x; });
+                }
+            }
+        }
+
+        //  Moment matching: Gaussians of every dimension with exact mean 0 and variance 1 over the block
+        //  Note: this introduces a (small) bias, which vanishes with the block size
+        if (myMomentMatching && kind == Kind::gaussians && B > 1)
+        {
+            vector<double> mean(myDim, 0.0), var(myDim, 0.0);
+            for (const auto& path : myBlock)
+            {
+                for (size_t d = 0; d < myDim; ++d) mean[d] += path[d];
+            }
+            for (auto& m : mean) m /= B;
+            for (const auto& path : myBlock)
+            {
+                for (size_t d = 0; d < myDim; ++d) var[d] += (path[d] - mean[d]) * (path[d] - mean[d]);
+            }
+            for (auto& v : var) v = 1.0 / sqrt(v / (B - 1));
+            for (auto& path : myBlock)
+            {
+                for (size_t d = 0; d < myDim; ++d) path[d] = (path[d] - mean[d]) * var[d];
+            }
+        }
+
+        myBlockIdx = b;
+        myKind = kind;
+    }
+
+    //  New dimension, no block
+    void reset(const size_t simDim)
+    {
+        myDim = simDim;
+        myBlock.clear();
+        myBlockIdx = 0;
+        myPos = 0;
+        myKind = Kind::none;
+    }
+
+    //  Next path of a given kind, swapped out of the block: no copy
+    void next(vector<double>& vec, const Kind kind)
+    {
+        //  Next block
+        if (myPos >= myBlockSize && myKind != Kind::none)
+        {
+            fill(myBlockIdx + 1, kind);
+            myPos = 0;
+        }
+        //  Switch of kind or block not filled
+        else if (myKind != kind)
+        {
+            fill(myBlockIdx, kind);
+        }
+
+        vec.swap(myBlock[myPos++]);
+    }
+
+public:
+
+    //  Constructor, antithetic by default
+    //  Block size is rounded up to even with antithetic
+    VarianceReduction(
+        unique_ptr<RNG>     rng,
+        const bool          antithetic = true,
+        const bool          momentMatching = false,
+        const bool          stratified = false,
+        const size_t        blockSize = 256) :
+        myRng(move(rng)),
+        myAntithetic(antithetic),
+        myMomentMatching(momentMatching),
+        myStratified(stratified),
+        myBlockSize(antithetic ? max<size_t>(2, blockSize + (blockSize & 1)) : max<size_t>(1, blockSize)),
+        myDim(0),
+        myBlockIdx(0),
+        myPos(0),
+        myKind(Kind::none) {}
+
+    //  Copy: clone the underlying RNG
+    //  The block is not copied, the copy regenerates it when needed
+    VarianceReduction(const VarianceReduction& rhs) :
+        myRng(rhs.myRng->clone()),
+        myAntithetic(rhs.myAntithetic),
+        myMomentMatching(rhs.myMomentMatching),
+        myStratified(rhs.myStratified),
+        myBlockSize(rhs.myBlockSize),
+        myDim(rhs.myDim),
+        myBlockIdx(rhs.myBlockIdx),
+        myPos(rhs.myPos),
+        myKind(Kind::none) {}
+
+    //  Virtual copy constructor
+    unique_ptr<RNG> clone() const override
+    {
+        return make_unique<VarianceReduction>(*this);
+    }
+
+    //  Initializers, the steps are forwarded to the underlying RNG
+    void init(const size_t simDim) override
+    {
+        myRng->init(simDim);
+        reset(simDim);
+    }
+
+    void initSteps(const vector<double>& stepTimes) override
+    {
+        myRng->initSteps(stepTimes);
+        reset(stepTimes.size());
+    }
+
+    //  The vectors must be pre-allocated with size simDim
+    //  Note that they are swapped with the working memory, not copied
+    void nextU(vector<double>& uVec) override
+    {
+        next(uVec, Kind::uniforms);
+    }
+
+    void nextG(vector<double>& gaussVec) override
+    {
+        next(gaussVec, Kind::gaussians);
+    }
+
+    //  Skip ahead, the block is regenerated on the next call
+    void skipTo(const unsigned long long b) override
+    {
+        myBlockIdx = b / myBlockSize;
+        myPos = size_t(b % myBlockSize);
+        myKind = Kind::none;
+    }
+};
@@ -21,6 +21,9 @@ As long as this comment is preserved at the top of the file
 #include "dupireBarrier.h"
 #include "sobol.h"
 #include "mrg32k3a.h"
+#include "brownianBridge.h"
+#include "philox.h"
+#include "varianceReduction.h"
 
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
@@ -89,12 +92,16 @@ double xDupireBarrierPricer(
     double              useSobol,
     double              seed1,
     double              seed2,
-    double              parallel)
+    double              parallel,
+    double              continuous)
 {
     FreeAllTempMemory();
 
-    //  Make sure we have paths and steps
-    if (paths <= 0.0 || steps <= 0.0) return -1;
+    //  Make sure we have paths, batches and steps
+    if (paths <= 0.0 || batchSize <= 0.0 || steps < 1.0) return -1;
+
+    //  Make sure Sobol covers the dimension
+    if (useSobol > 0.5 && steps > Sobol::maxDim) return -1;
 
     //  Unpack
 
@@ -109,14 +116,27 @@ double xDupireBarrierPricer(
 
     //  Random Number Generator
     unique_ptr<RNG> rng;
-    if (useSobol > 0.5) rng = make_unique<Sobol>();
-    else rng = make_unique<mrg32k3a>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456);
+    //  Sobol always with Brownian bridge, so its best dimensions drive the coarse path
+    if (useSobol > 0.5) rng = make_unique<BrownianBridgeRNG>(make_unique<Sobol>());
+    //  Otherwise counter-based Philox: free skip ahead and trivial clones for parallel batches
+    //      with antithetic sampling
+    else rng = make_unique<VarianceReduction>(
+        make_unique<Philox>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456));
 	rng->init(int(steps));
 
-    //  Call and return
-    return parallel > 0.5 
-        ? dupireBarrierPricerMT(spot, vspots, vtimes, vvols, mat, strike, barrier, int(paths), int(batchSize), int(steps), spot*epsilon, *rng)
-        : dupireBarrierPricer(spot, vspots, vtimes, vvols, mat, strike, barrier, int(paths), int(batchSize), int(steps), spot*epsilon, *rng);
+    //  Call and return, -1 on error
+    try
+    {
+        return parallel > 0.5 
+            ? dupireBarrierPricerMT(spot, vspots, vtimes, vvols, mat, strike, barrier, (long long)(paths), int(batchSize), int(steps), spot*epsilon, *rng,
+                continuous > 0.5)
+            : dupireBarrierPricer(spot, vspots, vtimes, vvols, mat, strike, barrier, (long long)(paths), int(batchSize), int(steps), spot*epsilon, *rng,
+                continuous > 0.5);
+    }
+    catch (const exception&)
+    {
+        return -1;
+    }
 }
 
 extern "C" __declspec(dllexport)
@@ -136,12 +156,16 @@ LPXLOPER12 xDupireBarrierRisks(
     double              useSobol,
     double              seed1,
     double              seed2,
-    double              parallel)
+    double              parallel,
+    double              continuous)
 {
     FreeAllTempMemory();
 
-    //  Make sure we have paths and steps
-    if (paths <= 0.0 || steps <= 0.0) TempErr12(xlerrNA);
+    //  Make sure we have paths, batches and steps
+    if (paths <= 0.0 || batchSize <= 0.0 || steps < 1.0) return TempErr12(xlerrNA);
+
+    //  Make sure Sobol covers the dimension
+    if (useSobol > 0.5 && steps > Sobol::maxDim) return TempErr12(xlerrNA);
 
     //  Unpack
 
@@ -156,23 +180,34 @@ LPXLOPER12 xDupireBarrierRisks(
 
     //  Random Number Generator
     unique_ptr<RNG> rng;
-    if (useSobol > 0.5) rng = make_unique<Sobol>();
-    else rng = make_unique<mrg32k3a>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456);
+    //  Sobol always with Brownian bridge, so its best dimensions drive the coarse path
+    if (useSobol > 0.5) rng = make_unique<BrownianBridgeRNG>(make_unique<Sobol>());
+    //  Otherwise counter-based Philox: free skip ahead and trivial clones for parallel batches
+    //      with antithetic sampling
+    else rng = make_unique<VarianceReduction>(
+        make_unique<Philox>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456));
 	rng->init(int(steps));
 
     //  Call 
 	double price, delta;
 	matrix<double> vegas(vvols.rows(), vvols.cols());
     
-    if (parallel > 0.5)
+    try
     {
-        dupireBarrierRisksMT(spot, vspots, vtimes, vvols, mat, strike, barrier, int(paths), int(batchSize), int(steps), spot*epsilon, *rng,
-		    price, delta, vegas);        
+        if (parallel > 0.5)
+        {
+            dupireBarrierRisksMT(spot, vspots, vtimes, vvols, mat, strike, barrier, (long long)(paths), int(batchSize), int(steps), spot*epsilon, *rng,
+		        price, delta, vegas, continuous > 0.5);
+        }
+        else
+        {
+            dupireBarrierRisks(spot, vspots, vtimes, vvols, mat, strike, barrier, (long long)(paths), int(batchSize), int(steps), spot*epsilon, *rng,
+		        price, delta, vegas, continuous > 0.5);
+        }
     }
-    else
+    catch (const exception&)
     {
-        dupireBarrierRisks(spot, vspots, vtimes, vvols, mat, strike, barrier, int(paths), int(batchSize), int(steps), spot*epsilon, *rng,
-		    price, delta, vegas);    
+        return TempErr12(xlerrNA);
     }
 
 	//	Pack and return
@@ -190,6 +225,340 @@ LPXLOPER12 xDupireBarrierRisks(
 	return results;
 }
 
+extern "C" __declspec(dllexport)
+LPXLOPER12 xDupireBarrierPricerRQMC(
+    //  model parameters
+    double              spot,
+    FP12*               spots,
+    FP12*               times,
+    FP12*               vols,
+    double              mat,
+    double              strike,
+    double              barrier,
+    double              paths,
+    double              batchSize,
+    double              steps,
+    double              epsilon,
+    double              replications,
+    double              seed)
+{
+    FreeAllTempMemory();
+
+    //  Make sure we have paths, batches, steps and replications
+    if (paths <= 0.0 || batchSize <= 0.0 || steps < 1.0 || replications < 1.0) return TempErr12(xlerrNA);
+
+    //  Make sure Sobol covers the dimension
+    if (steps > Sobol::maxDim) return TempErr12(xlerrNA);
+
+    //  Unpack
+
+    if (spots->rows * spots->columns * times->rows * times->columns != vols->rows * vols->columns)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+    vector<double> vspots = to_vector(spots);
+    vector<double> vtimes = to_vector(times);
+    matrix<double> vvols = to_matrix(vols);
+
+    //  Independent scrambled Sobol sequences, with Brownian bridge
+    const unsigned s0 = seed > 0.5 ? unsigned(seed) : 12345;
+    vector<unique_ptr<RNG>> rngs;
+    for (int r = 0; r < int(replications); ++r)
+    {
+        rngs.push_back(make_unique<BrownianBridgeRNG>(
+            make_unique<Sobol>(Sobol::Scrambling::lms, s0 + r)));
+    }
+
+    //  Call 
+    double price, stdErr;
+    try
+    {
+        dupireBarrierPricerRQMC(spot, vspots, vtimes, vvols, mat, strike, barrier, (long long)(paths), int(batchSize), int(steps), spot*epsilon, rngs,
+            price, stdErr);
+    }
+    catch (const exception&)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+	//	Pack and return
+	LPXLOPER12 results = TempXLOPER12();
+	resize(results, 2, 1);
+	setNum(results, price, 0, 0);
+	setNum(results, stdErr, 1, 0);
+
+	return results;
+}
+
+extern "C" __declspec(dllexport)
+LPXLOPER12 xDupireBarrierPricerAdaptive(
+    //  model parameters
+    double              spot,
+    FP12*               spots,
+    FP12*               times,
+    FP12*               vols,
+    double              mat,
+    double              strike,
+    double              barrier,
+    double              tolerance,
+    double              maxPaths,
+    double              maxSeconds,
+    double              batchSize,
+    double              steps,
+    double              epsilon,
+    double              seed1,
+    double              seed2)
+{
+    FreeAllTempMemory();
+
+    //  Make sure we have a tolerance, paths and steps
+    if (tolerance < 0.0 || maxPaths <= 0.0 || batchSize <= 0.0 || steps < 1.0) return TempErr12(xlerrNA);
+
+    //  Unpack
+
+    if (spots->rows * spots->columns * times->rows * times->columns != vols->rows * vols->columns)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+    vector<double> vspots = to_vector(spots);
+    vector<double> vtimes = to_vector(times);
+    matrix<double> vvols = to_matrix(vols);
+
+    //  Philox with antithetic sampling: batches are independent, so their dispersion measures the error
+    VarianceReduction rng(
+        make_unique<Philox>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456));
+
+    //  Call 
+    double price, stdErr;
+    long long paths;
+    try
+    {
+        dupireBarrierPricerAdaptive(spot, vspots, vtimes, vvols, mat, strike, barrier, int(batchSize), int(steps), spot*epsilon, rng,
+            tolerance, (long long)(maxPaths), maxSeconds, price, stdErr, paths);
+    }
+    catch (const exception&)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+	//	Pack and return
+	LPXLOPER12 results = TempXLOPER12();
+	resize(results, 3, 1);
+	setNum(results, price, 0, 0);
+	setNum(results, stdErr, 1, 0);
+	setNum(results, double(paths), 2, 0);
+
+	return results;
+}
+
+extern "C" __declspec(dllexport)
+LPXLOPER12 xDupireBarrierPricerMLMC(
+    //  model parameters
+    double              spot,
+    FP12*               spots,
+    FP12*               times,
+    FP12*               vols,
+    double              mat,
+    double              strike,
+    double              barrier,
+    double              tolerance,
+    double              maxPaths,
+    double              batchSize,
+    double              steps,
+    double              levels,
+    double              epsilon,
+    double              seed1,
+    double              seed2)
+{
+    FreeAllTempMemory();
+
+    //  Make sure we have a tolerance, paths, steps and levels
+    if (tolerance <= 0.0 || maxPaths <= 0.0 || batchSize <= 0.0 || steps < 1.0 || levels < 1.0 || levels > 16.0)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+    //  Unpack
+
+    if (spots->rows * spots->columns * times->rows * times->columns != vols->rows * vols->columns)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+    vector<double> vspots = to_vector(spots);
+    vector<double> vtimes = to_vector(times);
+    matrix<double> vvols = to_matrix(vols);
+
+    //  Philox with antithetic sampling
+    VarianceReduction rng(
+        make_unique<Philox>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456));
+
+    //  Call 
+    double price, stdErr;
+    vector<long long> paths;
+    try
+    {
+        dupireBarrierPricerMLMC(spot, vspots, vtimes, vvols, mat, strike, barrier, int(batchSize), int(steps), int(levels), spot*epsilon, rng,
+            tolerance, (long long)(maxPaths), price, stdErr, paths);
+    }
+    catch (const exception&)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+	//	Pack and return: price, standard error, then paths by level
+	LPXLOPER12 results = TempXLOPER12();
+	resize(results, 2 + paths.size(), 1);
+	setNum(results, price, 0, 0);
+	setNum(results, stdErr, 1, 0);
+    for (size_t l = 0; l < paths.size(); ++l) setNum(results, double(paths[l]), 2 + l, 0);
+
+	return results;
+}
+
+extern "C" __declspec(dllexport)
+LPXLOPER12 xDupireBarrierPricerCV(
+    //  model parameters
+    double              spot,
+    FP12*               spots,
+    FP12*               times,
+    FP12*               vols,
+    double              mat,
+    double              strike,
+    double              barrier,
+    double              paths,
+    double              batchSize,
+    double              steps,
+    double              epsilon,
+    double              seed1,
+    double              seed2,
+    double              continuous)
+{
+    FreeAllTempMemory();
+
+    //  Make sure we have paths and steps
+    if (paths <= 1.0 || batchSize <= 0.0 || steps < 1.0) return TempErr12(xlerrNA);
+
+    //  Unpack
+
+    if (spots->rows * spots->columns * times->rows * times->columns != vols->rows * vols->columns)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+    vector<double> vspots = to_vector(spots);
+    vector<double> vtimes = to_vector(times);
+    matrix<double> vvols = to_matrix(vols);
+
+    //  Philox with antithetic sampling
+    VarianceReduction rng(
+        make_unique<Philox>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456));
+
+    //  Call 
+    double price, stdErr;
+    try
+    {
+        dupireBarrierPricerCV(spot, vspots, vtimes, vvols, mat, strike, barrier, (long long)(paths), int(batchSize), int(steps), spot*epsilon, rng,
+            price, stdErr, continuous > 0.5);
+    }
+    catch (const exception&)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+	//	Pack and return
+	LPXLOPER12 results = TempXLOPER12();
+	resize(results, 2, 1);
+	setNum(results, price, 0, 0);
+	setNum(results, stdErr, 1, 0);
+
+	return results;
+}
+
+extern "C" __declspec(dllexport)
+LPXLOPER12 xDupireBarriersPricer(
+    //  model parameters
+    double              spot,
+    FP12*               spots,
+    FP12*               times,
+    FP12*               vols,
+    //  products, one per row
+    FP12*               mats,
+    FP12*               strikes,
+    FP12*               barriers,
+    double              paths,
+    double              batchSize,
+    double              steps,
+    double              epsilon,
+    double              useSobol,
+    double              seed1,
+    double              seed2)
+{
+    FreeAllTempMemory();
+
+    //  Make sure we have paths, batches and steps
+    if (paths <= 0.0 || batchSize <= 0.0 || steps < 1.0) return TempErr12(xlerrNA);
+
+    //  Unpack
+
+    if (spots->rows * spots->columns * times->rows * times->columns != vols->rows * vols->columns)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+    vector<double> vspots = to_vector(spots);
+    vector<double> vtimes = to_vector(times);
+    matrix<double> vvols = to_matrix(vols);
+    vector<double> vmats = to_vector(mats);
+    vector<double> vstrikes = to_vector(strikes);
+    vector<double> vbarriers = to_vector(barriers);
+
+    //  Random Number Generator, see xDupireBarrierPricer
+    //  The engine builds the Brownian bridge on the merged timeline, with uneven steps when maturities differ
+    unique_ptr<RNG> rng;
+    if (useSobol > 0.5) rng = make_unique<BrownianBridgeRNG>(make_unique<Sobol>());
+    else rng = make_unique<VarianceReduction>(
+        make_unique<Philox>(seed1 > 0.5 ? int(seed1): 12345, seed2 > 0.5? int(seed2): 123456));
+
+    //  Call, all products on the same paths, in parallel
+    //  Throws on inconsistent products, or when the merged timeline exceeds the dimension of Sobol
+    vector<double> prices;
+    try
+    {
+        prices = dupireBarriersPricerMT(spot, vspots, vtimes, vvols, vmats, vstrikes, vbarriers,
+            (long long)(paths), int(batchSize), int(steps), spot*epsilon, *rng);
+    }
+    catch (const exception&)
+    {
+        return TempErr12(xlerrNA);
+    }
+
+	//	Pack and return
+	LPXLOPER12 results = TempXLOPER12();
+	resize(results, prices.size(), 1);
+	for (size_t k = 0; k < prices.size(); ++k) setNum(results, prices[k], k, 0);
+
+	return results;
+}
+
+extern "C" __declspec(dllexport)
+double xThreadPool(
+    //  number of threads, including Excel's, 0 for the number of hardware threads
+    double              threads,
+    //  pin threads to cores
+    double              affinity)
+{
+    FreeAllTempMemory();
+
+    if (threads < 0.0) return -1;
+
+    ThreadPool::instance().start(size_t(threads + EPS), affinity > 0.5);
+
+    return double(ThreadPool::instance().numThreads());
+}
+
 //	Registers
 
 extern "C" __declspec(dllexport) int xlAutoOpen(void)
@@ -200,9 +569,9 @@ extern "C" __declspec(dllexport) int xlAutoOpen(void)
 
     Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
         (LPXLOPER12)TempStr12(L"xDupireBarrierPricer"),
-        (LPXLOPER12)TempStr12(L"BBK%K%K%BBBBBBBBBBB"),
+        (LPXLOPER12)TempStr12(L"BBK%K%K%BBBBBBBBBBBB"),
         (LPXLOPER12)TempStr12(L"xDupireBarrierPricer"),
-        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, paths, batchSize, steps, epsilon, useSobol, [seed1], [seed2], [parallel]"),
+        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, paths, batchSize, steps, epsilon, useSobol, [seed1], [seed2], [parallel], [continuous]"),
         (LPXLOPER12)TempStr12(L"1"),
         (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
         (LPXLOPER12)TempStr12(L""),
@@ -212,9 +581,9 @@ extern "C" __declspec(dllexport) int xlAutoOpen(void)
 
     Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
         (LPXLOPER12)TempStr12(L"xDupireBarrierRisks"),
-        (LPXLOPER12)TempStr12(L"QBK%K%K%BBBBBBBBBBB"),
+        (LPXLOPER12)TempStr12(L"QBK%K%K%BBBBBBBBBBBB"),
         (LPXLOPER12)TempStr12(L"xDupireBarrierRisks"),
-        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, paths, batchSize, steps, epsilon, useSobol, [seed1], [seed2], [parallel]"),
+        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, paths, batchSize, steps, epsilon, useSobol, [seed1], [seed2], [parallel], [continuous]"),
         (LPXLOPER12)TempStr12(L"1"),
         (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
         (LPXLOPER12)TempStr12(L""),
@@ -222,6 +591,78 @@ extern "C" __declspec(dllexport) int xlAutoOpen(void)
         (LPXLOPER12)TempStr12(L"Toy Dupire Barrier MC AAD risks"),
         (LPXLOPER12)TempStr12(L""));
 
+    Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerRQMC"),
+        (LPXLOPER12)TempStr12(L"QBK%K%K%BBBBBBBBB"),
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerRQMC"),
+        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, paths, batchSize, steps, epsilon, replications, [seed]"),
+        (LPXLOPER12)TempStr12(L"1"),
+        (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L"Toy Dupire Barrier randomized QMC, price and standard error"),
+        (LPXLOPER12)TempStr12(L""));
+
+    Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerAdaptive"),
+        (LPXLOPER12)TempStr12(L"QBK%K%K%BBBBBBBBBBB"),
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerAdaptive"),
+        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, tolerance, maxPaths, maxSeconds, batchSize, steps, epsilon, [seed1], [seed2]"),
+        (LPXLOPER12)TempStr12(L"1"),
+        (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L"Toy Dupire Barrier MC, paths until the standard error falls below tolerance, price, standard error and paths"),
+        (LPXLOPER12)TempStr12(L""));
+
+    Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerMLMC"),
+        (LPXLOPER12)TempStr12(L"QBK%K%K%BBBBBBBBBBB"),
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerMLMC"),
+        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, tolerance, maxPaths, batchSize, steps, levels, epsilon, [seed1], [seed2]"),
+        (LPXLOPER12)TempStr12(L"1"),
+        (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L"Toy Dupire Barrier multilevel MC, price, standard error and paths by level"),
+        (LPXLOPER12)TempStr12(L""));
+
+    Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerCV"),
+        (LPXLOPER12)TempStr12(L"QBK%K%K%BBBBBBBBBB"),
+        (LPXLOPER12)TempStr12(L"xDupireBarrierPricerCV"),
+        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mat, strike, barrier, paths, batchSize, steps, epsilon, [seed1], [seed2], [continuous]"),
+        (LPXLOPER12)TempStr12(L"1"),
+        (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L"Toy Dupire Barrier MC with Black-Scholes control variates, price and standard error"),
+        (LPXLOPER12)TempStr12(L""));
+
+    Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
+        (LPXLOPER12)TempStr12(L"xDupireBarriersPricer"),
+        (LPXLOPER12)TempStr12(L"QBK%K%K%K%K%K%BBBBBBB"),
+        (LPXLOPER12)TempStr12(L"xDupireBarriersPricer"),
+        (LPXLOPER12)TempStr12(L"spot, spots, times, vols, mats, strikes, barriers, paths, batchSize, steps, epsilon, useSobol, [seed1], [seed2]"),
+        (LPXLOPER12)TempStr12(L"1"),
+        (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L"Toy Dupire Barrier MC, a book of barriers priced on the same paths"),
+        (LPXLOPER12)TempStr12(L""));
+
+    Excel12f(xlfRegister, 0, 11, (LPXLOPER12)&xDLL,
+        (LPXLOPER12)TempStr12(L"xThreadPool"),
+        (LPXLOPER12)TempStr12(L"BBB"),
+        (LPXLOPER12)TempStr12(L"xThreadPool"),
+        (LPXLOPER12)TempStr12(L"threads, [affinity]"),
+        (LPXLOPER12)TempStr12(L"1"),
+        (LPXLOPER12)TempStr12(L"myOwnCppFunctions"),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L""),
+        (LPXLOPER12)TempStr12(L"Restarts the thread pool of the parallel pricers, returns the number of threads"),
+        (LPXLOPER12)TempStr12(L""));
+
 	/* Free the XLL filename */
 	Excel12f(xlFree, 0, 1, (LPXLOPER12)&xDLL);
 
@@ -230,6 +671,8 @@ extern "C" __declspec(dllexport) int xlAutoOpen(void)
 
 extern "C" __declspec(dllexport) int xlAutoClose(void)
 {
+    //  Join the threads of the pool before the DLL is unloaded
+    ThreadPool::instance().stop();
 
     return 1;
 }
\ No newline at end of file